@@ -0,0 +1,110 @@
+#include <stdlib.h>
+
+// Writes and reads BYTE_IO_BENCH_N numbers through ByteOP/ByteIP, see "make bench_bytes"
+
+#include "general.h"
+
+#ifndef BYTE_IO_BENCH_N
+#define BYTE_IO_BENCH_N (1 << 25)
+#endif
+
+const char *BENCH_FILE_NAME = "byte_io_bench.bin";
+
+typedef enum BenchEncoding_t {
+    ENCODING_NATIVE,
+    ENCODING_U32_LE,
+    ENCODING_VARINT,
+} BenchEncoding;
+
+const char *ENCODING_NAMES[] = {"native", "u32_le", "varint"};
+
+// small numbers most of the time, like indexes and sizes, so varint has something to win
+uint32_t bench_value(const uint32_t i) {
+    return i % 16 ? i % 1000 : i;
+}
+
+int bench_put(ByteOP *bop, const BenchEncoding encoding) {
+    for (uint32_t i = 0; i < BYTE_IO_BENCH_N; ++i) {
+        const uint32_t value = bench_value(i);
+        if (encoding == ENCODING_NATIVE) {
+            ByteOP_put_int(bop, (int) value);
+        } else if (encoding == ENCODING_U32_LE) {
+            ByteOP_put_u32_le(bop, value);
+        } else {
+            ByteOP_put_varint(bop, value);
+        }
+    }
+
+    return 0;
+}
+
+uint64_t bench_get(ByteIP *bip, const BenchEncoding encoding) {
+    uint64_t checksum = 0;
+    for (uint32_t i = 0; i < BYTE_IO_BENCH_N; ++i) {
+        if (encoding == ENCODING_NATIVE) {
+            int value = 0;
+            ByteIP_get_int(bip, &value);
+            checksum += (uint64_t) value;
+        } else if (encoding == ENCODING_U32_LE) {
+            uint32_t value = 0;
+            ByteIP_get_u32_le(bip, &value);
+            checksum += value;
+        } else {
+            uint64_t value = 0;
+            ByteIP_get_varint(bip, &value);
+            checksum += value;
+        }
+    }
+
+    return checksum;
+}
+
+void bench_encoding(const BenchEncoding encoding) {
+    const size_t presize = BYTE_IO_BENCH_N; // too small on purpose, both have to grow
+
+    TIMER_START();
+    ByteOP *heap_bop = new_ByteOP(presize);
+    bench_put(heap_bop, encoding);
+    ByteOP_to_file(heap_bop, BENCH_FILE_NAME);
+    const size_t file_size = heap_bop->size;
+    delete_ByteOP(heap_bop);
+    TIMER_BREAK();
+    const double heap_write = GLOBAL_TIMER_INTERVAL;
+
+    TIMER_START();
+    ByteOP *mmap_bop = new_ByteOP_mmap(BENCH_FILE_NAME, presize);
+    bench_put(mmap_bop, encoding);
+    delete_ByteOP(mmap_bop);
+    TIMER_BREAK();
+    const double mmap_write = GLOBAL_TIMER_INTERVAL;
+
+    TIMER_START();
+    ByteIP *heap_bip = new_ByteIP(file_size);
+    ByteIP_read_file(heap_bip, BENCH_FILE_NAME, file_size);
+    const uint64_t heap_checksum = bench_get(heap_bip, encoding);
+    delete_ByteIP(heap_bip);
+    TIMER_BREAK();
+    const double heap_read = GLOBAL_TIMER_INTERVAL;
+
+    TIMER_START();
+    ByteIP *mmap_bip = new_ByteIP_mmap(BENCH_FILE_NAME);
+    const uint64_t mmap_checksum = bench_get(mmap_bip, encoding);
+    delete_ByteIP(mmap_bip);
+    TIMER_BREAK();
+    const double mmap_read = GLOBAL_TIMER_INTERVAL;
+
+    const double megabytes = (double) file_size / (1 << 20);
+    printf("[BNC]<byte_io>: [encoding](%-6s) [size](%6.1lf MB) [write heap/mmap](%7.1lf / %7.1lf MB/s) [read heap/mmap](%7.1lf / %7.1lf MB/s) [same](%d)\n",
+           ENCODING_NAMES[encoding], megabytes, megabytes / heap_write, megabytes / mmap_write,
+           megabytes / heap_read, megabytes / mmap_read, heap_checksum == mmap_checksum);
+
+    remove(BENCH_FILE_NAME);
+}
+
+int main() {
+    bench_encoding(ENCODING_NATIVE);
+    bench_encoding(ENCODING_U32_LE);
+    bench_encoding(ENCODING_VARINT);
+
+    return 0;
+}
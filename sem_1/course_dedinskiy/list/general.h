@@ -98,6 +98,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <stdint.h>
 #include <time.h>
@@ -223,11 +224,18 @@ long randlong() {
 
 //=============================================================================
 //<KCTF> GLOBAL_timer =========================================================
-time_t GLOBAL_TIMER;
+// wall clock, seconds; for named, nested or per-thread timings see KCTF_PROFILE_SCOPE
+double GLOBAL_TIMER;
 double GLOBAL_TIMER_INTERVAL;
 
-#define TIMER_START() do {GLOBAL_TIMER = clock();} while (0)
-#define TIMER_BREAK() do {GLOBAL_TIMER_INTERVAL = (double)(clock() - GLOBAL_TIMER) / CLOCKS_PER_SEC;} while(0)
+double kctf_wall_seconds() {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+#define TIMER_START() do {GLOBAL_TIMER = kctf_wall_seconds();} while (0)
+#define TIMER_BREAK() do {GLOBAL_TIMER_INTERVAL = kctf_wall_seconds() - GLOBAL_TIMER;} while(0)
 #define TIMER_END() do {TIMER_BREAK(); TIMER_START();} while (0)
 
 #define TIMER_PRINT() do {printf("[...]<Timer>: %lf\n", GLOBAL_TIMER_INTERVAL);} while (0)
@@ -235,27 +243,333 @@ double GLOBAL_TIMER_INTERVAL;
 #define TIMER_BREAK_AND_PRINT() do {TIMER_BREAK(); TIMER_PRINT();} while(0)
 
 
+//=============================================================================
+//<KCTF> Profiling ============================================================
+
+// KCTF_PROFILE turns KCTF_PROFILE_SCOPE(name) on: it times the rest of the enclosing block
+// (wall clock, or TSC with KCTF_PROFILE_RDTSC), scopes nest freely. Every thread fills its
+// own table, so recording takes no locks; all tables are merged into one report at exit:
+// calls, total, mean and log-linear histogram percentiles (8 sub-buckets per power of two,
+// so a percentile is off by 1/16 of its value at most, like HdrHistogram with 1 digit).
+// Scopes use __attribute__((cleanup)): C++ built with gcc needs -fno-exceptions or libstdc++.
+
+#ifdef KCTF_PROFILE
+
+#include <pthread.h>
+#include <time.h>
+#if defined(KCTF_PROFILE_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define KCTF_PROFILE_USE_TSC 1
+#endif
+
+#define KCTF_PROFILE_MAX_REGIONS 64
+#define KCTF_PROFILE_SUB_BITS    3
+#define KCTF_PROFILE_BUCKETS     (64 << KCTF_PROFILE_SUB_BITS)
+
+typedef struct KctfProfileRegion_t {
+    uint64_t calls;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[KCTF_PROFILE_BUCKETS];
+} KctfProfileRegion;
+
+typedef struct KctfProfileTable_t {
+    KctfProfileRegion regions[KCTF_PROFILE_MAX_REGIONS];
+    struct KctfProfileTable_t *next_table;
+} KctfProfileTable;
+
+typedef struct KctfProfileScope_t {
+    int      region;
+    uint64_t start;
+} KctfProfileScope;
+
+pthread_mutex_t   kctf_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+const char       *kctf_profile_names[KCTF_PROFILE_MAX_REGIONS];
+int               kctf_profile_regions_cnt = 0;
+KctfProfileTable *kctf_profile_tables = NULL;
+__thread KctfProfileTable *kctf_profile_my_table = NULL;
+
+uint64_t kctf_profile_start_ticks = 0;
+uint64_t kctf_profile_start_ns    = 0;
+
+static inline uint64_t kctf_profile_ns() {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+static inline uint64_t kctf_profile_ticks() {
+#ifdef KCTF_PROFILE_USE_TSC
+    return __rdtsc();
+#else
+    return kctf_profile_ns();
+#endif
+}
+
+static inline int kctf_profile_bucket(const uint64_t value) {
+    if (value < (1 << KCTF_PROFILE_SUB_BITS)) {
+        return (int) value;
+    }
+    const int exp = 63 - __builtin_clzll(value);
+    const int sub = (int) (value >> (exp - KCTF_PROFILE_SUB_BITS)) & ((1 << KCTF_PROFILE_SUB_BITS) - 1);
+    return ((exp - KCTF_PROFILE_SUB_BITS + 1) << KCTF_PROFILE_SUB_BITS) + sub;
+}
+
+/// middle of the values that fall into bucket
+double kctf_profile_bucket_value(const int bucket);
+double kctf_profile_bucket_value(const int bucket) {
+    if (bucket < (1 << KCTF_PROFILE_SUB_BITS)) {
+        return bucket;
+    }
+    const int exp = (bucket >> KCTF_PROFILE_SUB_BITS) + KCTF_PROFILE_SUB_BITS - 1;
+    const int sub = bucket & ((1 << KCTF_PROFILE_SUB_BITS) - 1);
+    const double low   = (double) ((((uint64_t) 1 << KCTF_PROFILE_SUB_BITS) + (uint64_t) sub) << (exp - KCTF_PROFILE_SUB_BITS));
+    const double width = (double) ((uint64_t) 1 << (exp - KCTF_PROFILE_SUB_BITS));
+    return low + width / 2;
+}
+
+double kctf_profile_percentile(const KctfProfileRegion *region, const double fraction);
+double kctf_profile_percentile(const KctfProfileRegion *region, const double fraction) {
+    const uint64_t rank = (uint64_t) ((double) region->calls * fraction);
+    uint64_t seen = 0;
+    for (int i = 0; i < KCTF_PROFILE_BUCKETS; ++i) {
+        seen += region->buckets[i];
+        if (seen > rank) {
+            const double value = kctf_profile_bucket_value(i);
+            return value < (double) region->max ? value : (double) region->max;
+        }
+    }
+    return 0;
+}
+
+void kctf_profile_report();
+void kctf_profile_report() {
+    pthread_mutex_lock(&kctf_profile_lock);
+
+    double ns_per_tick = 1;
+#ifdef KCTF_PROFILE_USE_TSC
+    const uint64_t ticks = kctf_profile_ticks() - kctf_profile_start_ticks;
+    const uint64_t ns    = kctf_profile_ns()    - kctf_profile_start_ns;
+    ns_per_tick = ticks ? (double) ns / (double) ticks : 1;
+#endif
+
+    KctfProfileRegion *merged = (KctfProfileRegion*) calloc(1, sizeof(KctfProfileRegion));
+    for (int region = 0; region < kctf_profile_regions_cnt && merged; ++region) {
+        memset(merged, 0, sizeof(KctfProfileRegion));
+        for (KctfProfileTable *table = kctf_profile_tables; table; table = table->next_table) {
+            const KctfProfileRegion *cur = &table->regions[region];
+            merged->calls += cur->calls;
+            merged->total += cur->total;
+            merged->max    = cur->max > merged->max ? cur->max : merged->max;
+            for (int i = 0; i < KCTF_PROFILE_BUCKETS; ++i) {
+                merged->buckets[i] += cur->buckets[i];
+            }
+        }
+        if (!merged->calls) {
+            continue;
+        }
+
+        printf("[PRF]<%s>: [calls](%llu) [total](%.3lf ms) [mean](%.1lf ns) "
+               "[p50](%.0lf ns) [p90](%.0lf ns) [p99](%.0lf ns) [p99.9](%.0lf ns) [max](%.0lf ns)\n",
+               kctf_profile_names[region], (unsigned long long) merged->calls,
+               (double) merged->total * ns_per_tick / 1e6,
+               (double) merged->total * ns_per_tick / (double) merged->calls,
+               kctf_profile_percentile(merged, 0.5)   * ns_per_tick,
+               kctf_profile_percentile(merged, 0.9)   * ns_per_tick,
+               kctf_profile_percentile(merged, 0.99)  * ns_per_tick,
+               kctf_profile_percentile(merged, 0.999) * ns_per_tick,
+               (double) merged->max * ns_per_tick);
+    }
+    free(merged);
+
+    pthread_mutex_unlock(&kctf_profile_lock);
+}
+
+/// Same id for the same name from any thread, called once per KCTF_PROFILE_SCOPE site
+int kctf_profile_region_id(const char *name);
+int kctf_profile_region_id(const char *name) {
+    pthread_mutex_lock(&kctf_profile_lock);
+
+    if (!kctf_profile_regions_cnt && !kctf_profile_tables) {
+        kctf_profile_start_ticks = kctf_profile_ticks();
+        kctf_profile_start_ns    = kctf_profile_ns();
+        atexit(kctf_profile_report);
+    }
+
+    int id = 0;
+    while (id < kctf_profile_regions_cnt && strcmp(kctf_profile_names[id], name)) {
+        ++id;
+    }
+    if (id == kctf_profile_regions_cnt && id < KCTF_PROFILE_MAX_REGIONS) {
+        kctf_profile_names[kctf_profile_regions_cnt++] = name;
+    }
+
+    pthread_mutex_unlock(&kctf_profile_lock);
+    return id < KCTF_PROFILE_MAX_REGIONS ? id : -1;
+}
+
+KctfProfileTable *kctf_profile_new_table();
+KctfProfileTable *kctf_profile_new_table() {
+    KctfProfileTable *table = (KctfProfileTable*) calloc(1, sizeof(KctfProfileTable));
+    if (!table) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&kctf_profile_lock);
+    table->next_table = kctf_profile_tables;
+    kctf_profile_tables = table;
+    pthread_mutex_unlock(&kctf_profile_lock);
+
+    return table;
+}
+
+static inline void kctf_profile_scope_end(KctfProfileScope *scope) {
+    const uint64_t elapsed = kctf_profile_ticks() - scope->start;
+    if (scope->region < 0) {
+        return;
+    }
+    if (!kctf_profile_my_table && !(kctf_profile_my_table = kctf_profile_new_table())) {
+        return;
+    }
+
+    KctfProfileRegion *region = &kctf_profile_my_table->regions[scope->region];
+    ++region->calls;
+    region->total += elapsed;
+    region->max    = elapsed > region->max ? elapsed : region->max;
+    ++region->buckets[kctf_profile_bucket(elapsed)];
+}
+
+#define KCTF_PROFILE_CONCAT_(a, b) a ## b
+#define KCTF_PROFILE_CONCAT(a, b) KCTF_PROFILE_CONCAT_(a, b)
+
+#define KCTF_PROFILE_SCOPE(name)                                                                        \
+    static int KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__) = -2;                                    \
+    if (__atomic_load_n(&KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__), __ATOMIC_RELAXED) == -2) {   \
+        __atomic_store_n(&KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__),                              \
+                         kctf_profile_region_id(name), __ATOMIC_RELAXED);                               \
+    }                                                                                                   \
+    KctfProfileScope KCTF_PROFILE_CONCAT(kctf_profile_scope_, __LINE__)                                 \
+        __attribute__((cleanup(kctf_profile_scope_end))) =                                              \
+        {__atomic_load_n(&KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__), __ATOMIC_RELAXED),          \
+         kctf_profile_ticks()}
+
+#else
+
+#define KCTF_PROFILE_SCOPE(name)
+
+#endif
+
 //=============================================================================
 //<Babichev> Fast_random ======================================================
 
+// FastRandom_fill runs FAST_RANDOM_LANES copies of the generator side by side in one GCC vector,
+// lane i starts (i + 1) * 2^FAST_RANDOM_LANE_LOG2 steps after rnd, so lanes never meet rnd or each other.
+// new_FastRandom_stream(seed, k) starts 2^FAST_RANDOM_STREAM_LOG2 * k steps later - one stream per thread.
+
+#define FAST_RANDOM_LANES      8
+#define FAST_RANDOM_LANE_LOG2  40
+#define FAST_RANDOM_STREAM_LOG2 48
+
+typedef unsigned long long FastRandomVec __attribute__((vector_size(FAST_RANDOM_LANES * sizeof(unsigned long long))));
+
 typedef struct FastRandom_s {
     unsigned long long rnd;
+    unsigned long long lanes[FAST_RANDOM_LANES];
+    int lanes_ready;
 } FastRandom;
 
 FastRandom *new_FastRandom(unsigned long long seed) {
-  FastRandom *t = (FastRandom*)malloc(sizeof (FastRandom));
+  FastRandom *t = (FastRandom*)calloc(1, sizeof (FastRandom));
   t->rnd = seed;
   return t;
 }
 
+static inline unsigned long long FastRandom_step(unsigned long long rnd) {
+  rnd ^= rnd << 21;
+  rnd ^= rnd >> 35;
+  rnd ^= rnd << 4;
+  return rnd;
+}
+
 unsigned long long 
 FastRandom_rand(FastRandom *t) {
-  t->rnd ^= t->rnd << 21;
-  t->rnd ^= t->rnd >> 35;
-  t->rnd ^= t->rnd << 4;
+  t->rnd = FastRandom_step(t->rnd);
   return t->rnd;
 }
 
+/// A step is linear over GF(2), column j of its matrix is step(1 << j)
+static inline unsigned long long FastRandom_matrix_apply(const unsigned long long *matrix, unsigned long long rnd) {
+  unsigned long long ret = 0;
+  for (int j = 0; rnd; ++j, rnd >>= 1) {
+    if (rnd & 1) {
+      ret ^= matrix[j];
+    }
+  }
+  return ret;
+}
+
+/// Advances rnd by 2^log2_steps steps in O(64^2 * log2_steps)
+unsigned long long FastRandom_jump_state(unsigned long long rnd, const unsigned log2_steps) {
+  unsigned long long matrix [64] = {};
+  unsigned long long squared[64] = {};
+  for (int j = 0; j < 64; ++j) {
+    matrix[j] = FastRandom_step((unsigned long long) 1 << j);
+  }
+
+  for (unsigned i = 0; i < log2_steps; ++i) {
+    for (int j = 0; j < 64; ++j) {
+      squared[j] = FastRandom_matrix_apply(matrix, matrix[j]);
+    }
+    memcpy(matrix, squared, sizeof(matrix));
+  }
+
+  return FastRandom_matrix_apply(matrix, rnd);
+}
+
+void FastRandom_jump(FastRandom *t, const unsigned log2_steps) {
+  t->rnd = FastRandom_jump_state(t->rnd, log2_steps);
+  t->lanes_ready = 0;
+}
+
+FastRandom *new_FastRandom_stream(unsigned long long seed, const unsigned stream) {
+  FastRandom *t = new_FastRandom(seed);
+  for (unsigned i = 0; i < stream; ++i) {
+    FastRandom_jump(t, FAST_RANDOM_STREAM_LOG2);
+  }
+  return t;
+}
+
+/// Fills buf[0..n) lane by lane: buf[k * FAST_RANDOM_LANES + i] is the k-th number of lane i
+void FastRandom_fill(FastRandom *t, unsigned long long *buf, const size_t n) {
+  if (!t->lanes_ready) {
+    unsigned long long rnd = t->rnd;
+    for (int i = 0; i < FAST_RANDOM_LANES; ++i) {
+      rnd = FastRandom_jump_state(rnd, FAST_RANDOM_LANE_LOG2);
+      t->lanes[i] = rnd;
+    }
+    t->lanes_ready = 1;
+  }
+
+  FastRandomVec lanes;
+  memcpy(&lanes, t->lanes, sizeof(lanes));
+
+  size_t i = 0;
+  for (; i + FAST_RANDOM_LANES <= n; i += FAST_RANDOM_LANES) {
+    lanes ^= lanes << 21;
+    lanes ^= lanes >> 35;
+    lanes ^= lanes << 4;
+    memcpy(buf + i, &lanes, sizeof(lanes));
+  }
+  if (i < n) {
+    lanes ^= lanes << 21;
+    lanes ^= lanes >> 35;
+    lanes ^= lanes << 4;
+    memcpy(buf + i, &lanes, (n - i) * sizeof(unsigned long long));
+  }
+
+  memcpy(t->lanes, &lanes, sizeof(lanes));
+}
+
 void delete_FastRandom(FastRandom *r) {
   free(r);
 }
@@ -287,13 +601,141 @@ char GLOBAL_EXPECTATION_FLAG;
 
 #define KCTF_UNIT_TEST(test_name) void KCTF_TEST_ ## test_name()
 
+//=============================================================================
+//<KCTF> Microbench ===========================================================
+
+// KCTF_BENCH(name) { setup; KCTF_BENCH_LOOP { measured code; } teardown; }
+// KCTF_BENCH_RUN(name) grows the iteration count x10 until one sample takes KCTF_BENCH_MIN_SECONDS,
+// then takes KCTF_BENCH_SAMPLES samples and prints ns/op mean, stddev and min.
+// kctf_bench_report_to("file.json" or "file.csv") also appends every result there.
+// Feed results to KCTF_DO_NOT_OPTIMIZE, or the compiler may drop the code measured.
+
+#include <time.h>
+
+#define KCTF_BENCH_SAMPLES     10
+#define KCTF_BENCH_MIN_SECONDS 0.02
+#define KCTF_BENCH_MAX_ITERS   ((size_t) 1 << 32)
+
+#define KCTF_DO_NOT_OPTIMIZE(value) __asm__ volatile("" : : "r,m"(value) : "memory")
+#define KCTF_CLOBBER_MEMORY()       __asm__ volatile("" : : : "memory")
+
+typedef struct KctfBenchState_t {
+    size_t iters;
+    size_t done;
+    double start;
+    double elapsed;
+} KctfBenchState;
+
+FILE *kctf_bench_report_file = NULL;
+int   kctf_bench_report_json = 0;
+int   kctf_bench_report_cnt  = 0;
+
+static inline int kctf_bench_keep_running(KctfBenchState *state) {
+    if (state->done == 0) {
+        state->start = kctf_wall_seconds();
+    }
+    if (state->done++ < state->iters) {
+        return 1;
+    }
+    state->elapsed = kctf_wall_seconds() - state->start;
+    return 0;
+}
+
+#define KCTF_BENCH_LOOP while (kctf_bench_keep_running(kctf_bench_state))
+
+#define KCTF_BENCH(bench_name) static void KCTF_BENCH_ ## bench_name(KctfBenchState *kctf_bench_state)
+
+// Newton's method, so that general.h users need no -lm
+static inline double kctf_bench_sqrt(const double x) {
+    if (x <= 0) {
+        return 0;
+    }
+
+    double root = x > 1 ? x : 1;
+    for (int i = 0; i < 64; ++i) {
+        root = (root + x / root) / 2;
+    }
+    return root;
+}
+
+int kctf_bench_report_to(const char *file_name);
+int kctf_bench_report_to(const char *file_name) {
+    const size_t len = strlen(file_name);
+    kctf_bench_report_json = len >= 5 && !strcmp(file_name + len - 5, ".json");
+    kctf_bench_report_file = fopen(file_name, "w");
+    if (!kctf_bench_report_file) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    kctf_bench_report_cnt = 0;
+    fprintf(kctf_bench_report_file, kctf_bench_report_json ? "[\n" : "name,ns_per_op,stddev_ns,min_ns,iterations,samples\n");
+    return 0;
+}
+
+int kctf_bench_report_close();
+int kctf_bench_report_close() {
+    if (!kctf_bench_report_file) {
+        return 0;
+    }
+    if (kctf_bench_report_json) {
+        fprintf(kctf_bench_report_file, "\n]\n");
+    }
+    fclose(kctf_bench_report_file);
+    kctf_bench_report_file = NULL;
+    return 0;
+}
+
+double kctf_bench_sample(void (*bench)(KctfBenchState*), const size_t iters);
+double kctf_bench_sample(void (*bench)(KctfBenchState*), const size_t iters) {
+    KctfBenchState state = {iters, 0, 0, 0};
+    bench(&state);
+    return state.elapsed;
+}
+
+int kctf_bench_run(const char *name, void (*bench)(KctfBenchState*));
+int kctf_bench_run(const char *name, void (*bench)(KctfBenchState*)) {
+    size_t iters = 1;
+    while (iters < KCTF_BENCH_MAX_ITERS && kctf_bench_sample(bench, iters) < KCTF_BENCH_MIN_SECONDS) {
+        iters *= 10;
+    }
+
+    double sum = 0, sum_sq = 0, min = 0;
+    for (int i = 0; i < KCTF_BENCH_SAMPLES; ++i) {
+        const double ns = kctf_bench_sample(bench, iters) * 1e9 / (double) iters;
+        sum    += ns;
+        sum_sq += ns * ns;
+        min     = (i == 0 || ns < min) ? ns : min;
+    }
+    const double mean     = sum / KCTF_BENCH_SAMPLES;
+    const double variance = sum_sq / KCTF_BENCH_SAMPLES - mean * mean;
+    const double stddev   = kctf_bench_sqrt(variance);
+
+    printf("[BNC]<%s>: [ns/op](%.2lf) [stddev](%.2lf) [min](%.2lf) [iters](%zu x %d)\n",
+           name, mean, stddev, min, iters, KCTF_BENCH_SAMPLES);
+
+    if (kctf_bench_report_file) {
+        if (kctf_bench_report_json) {
+            fprintf(kctf_bench_report_file,
+                    "%s  {\"name\": \"%s\", \"ns_per_op\": %.3lf, \"stddev_ns\": %.3lf, \"min_ns\": %.3lf, \"iterations\": %zu, \"samples\": %d}",
+                    kctf_bench_report_cnt ? ",\n" : "", name, mean, stddev, min, iters, KCTF_BENCH_SAMPLES);
+        } else {
+            fprintf(kctf_bench_report_file, "%s,%.3lf,%.3lf,%.3lf,%zu,%d\n", name, mean, stddev, min, iters, KCTF_BENCH_SAMPLES);
+        }
+        ++kctf_bench_report_cnt;
+    }
+
+    return 0;
+}
+
+#define KCTF_BENCH_RUN(bench_name) kctf_bench_run(#bench_name, KCTF_BENCH_ ## bench_name)
+
 //=============================================================================
 //<KCTF> Handmade_hash ========================================================
 
 const long long HASH_MODULE = 1000000007;
 const long long BASE = 257;
 
-#define get_hash(struct) do_hash(struct, sizeof(struct))
+#define get_hash(struct) KCTF_HASH(struct, sizeof(struct))
 long long do_hash(const void *memptr, size_t size_in_bytes);
 
 long long do_hash(const void *memptr, size_t size_in_bytes) {
@@ -306,6 +748,62 @@ long long do_hash(const void *memptr, size_t size_in_bytes) {
     return ret;
 }
 
+// Word-wide hash: 8 independent 32-bit lanes eat 32 bytes per step, lanes do not
+// depend on each other, so the loop is vectorized by gcc -O2/-O3 (SSE4.1/AVX2).
+// Result is reduced into [0, HASH_MODULE) to stay a drop-in for do_hash.
+// Define KCTF_HASH_BYTEWISE to fall back to do_hash everywhere KCTF_HASH is used.
+
+#define KCTF_HASH_LANES 8
+
+const uint32_t KCTF_HASH_PRIME_1 = 0x9E3779B1u;
+const uint32_t KCTF_HASH_PRIME_2 = 0x85EBCA77u;
+const uint32_t KCTF_HASH_PRIME_3 = 0xC2B2AE3Du;
+
+long long do_hash_words(const void *memptr, size_t size_in_bytes);
+
+long long do_hash_words(const void *memptr, size_t size_in_bytes) {
+    assert(memptr);
+    const unsigned char *ptr = (const unsigned char*) memptr;
+
+    uint32_t lanes[KCTF_HASH_LANES];
+    for (int i = 0; i < KCTF_HASH_LANES; ++i) {
+        lanes[i] = KCTF_HASH_PRIME_3 + (uint32_t) i * KCTF_HASH_PRIME_1;
+    }
+
+    const size_t step = KCTF_HASH_LANES * sizeof(uint32_t);
+    size_t i = 0;
+    for (; i + step <= size_in_bytes; i += step) {
+        uint32_t words[KCTF_HASH_LANES];
+        memcpy(words, ptr + i, step);
+        for (int j = 0; j < KCTF_HASH_LANES; ++j) {
+            uint32_t lane = lanes[j] + words[j] * KCTF_HASH_PRIME_2;
+            lane = (lane << 13) | (lane >> 19);
+            lanes[j] = lane * KCTF_HASH_PRIME_1;
+        }
+    }
+
+    uint64_t ret = (uint64_t) size_in_bytes * KCTF_HASH_PRIME_1;
+    for (int j = 0; j < KCTF_HASH_LANES; ++j) {
+        ret = (ret ^ lanes[j]) * 0x100000001B3ull;
+        ret ^= ret >> 29;
+    }
+
+    for (; i < size_in_bytes; ++i) {
+        ret = (ret ^ ptr[i]) * 0x100000001B3ull;
+    }
+
+    ret ^= ret >> 32;
+    ret *= KCTF_HASH_PRIME_2;
+    ret ^= ret >> 29;
+    return (long long) (ret % (uint64_t) HASH_MODULE);
+}
+
+#ifdef KCTF_HASH_BYTEWISE
+#define KCTF_HASH(memptr, size_in_bytes) do_hash(memptr, size_in_bytes)
+#else
+#define KCTF_HASH(memptr, size_in_bytes) do_hash_words(memptr, size_in_bytes)
+#endif
+
 //=============================================================================
 //<KCTF> Buffer work ==========================================================
 
@@ -325,6 +823,7 @@ typedef struct ByteOP_t {
     size_t size;
     byte *buffer;
     byte *cur_ptr;
+    int fd; ///< -1 for a heap buffer, else buffer is a shared mapping of this file
 } ByteOP;
 
 ByteOP *new_ByteOP(const size_t size) {
@@ -339,6 +838,42 @@ ByteOP *new_ByteOP(const size_t size) {
         return NULL;
     }
 
+    bop->cur_ptr = bop->buffer;
+    bop->capacity = size;
+    bop->size = 0;
+    bop->fd = -1;
+
+    return bop;
+}
+
+/// ByteOP that writes straight into a shared mapping of file_name, pre-sized to size bytes
+/// and remapped twice as big when full. delete_ByteOP cuts the file down to what was written.
+ByteOP *new_ByteOP_mmap(const char *file_name, size_t size) {
+    if (!size) {
+        size = STANDART_BYTE_LINE_BYTES_COUNT;
+    }
+
+    ByteOP *bop = calloc(sizeof(ByteOP), 1);
+    if (!bop) {
+        return NULL;
+    }
+
+    bop->fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (bop->fd < 0 || ftruncate(bop->fd, (off_t) size)) {
+        if (bop->fd >= 0) {
+            close(bop->fd);
+        }
+        free(bop);
+        return NULL;
+    }
+
+    bop->buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, bop->fd, 0);
+    if (bop->buffer == MAP_FAILED) {
+        close(bop->fd);
+        free(bop);
+        return NULL;
+    }
+
     bop->cur_ptr = bop->buffer;
     bop->capacity = size;
     bop->size = 0;
@@ -347,7 +882,13 @@ ByteOP *new_ByteOP(const size_t size) {
 }
 
 int delete_ByteOP(ByteOP *cake) {
-    free(cake->buffer);
+    if (cake->fd >= 0) {
+        munmap(cake->buffer, cake->capacity);
+        ftruncate(cake->fd, (off_t) cake->size);
+        close(cake->fd);
+    } else {
+        free(cake->buffer);
+    }
 
     cake->buffer = (byte*) KCTF_POISON;
     cake->cur_ptr = (byte*) KCTF_POISON;
@@ -359,8 +900,34 @@ int delete_ByteOP(ByteOP *cake) {
     return 0;
 }
 
+int ByteOP_remap_up(ByteOP *cake) {
+    assert(cake);
+    const size_t new_capacity = cake->capacity * 2;
+    if (ftruncate(cake->fd, (off_t) new_capacity)) {
+        return ERROR_REALLOC_FAIL;
+    }
+
+    // the file keeps everything written so far, so the old mapping can just go
+    munmap(cake->buffer, cake->capacity);
+    byte *new_ptr = mmap(NULL, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, cake->fd, 0);
+    if (new_ptr == MAP_FAILED) {
+        cake->buffer = NULL;
+        return ERROR_REALLOC_FAIL;
+    }
+
+    cake->buffer = new_ptr;
+    cake->cur_ptr = cake->buffer + cake->size;
+    cake->capacity = new_capacity;
+
+    return 0;
+}
+
 int ByteOP_realloc_up(ByteOP *cake) {
     assert(cake);
+    if (cake->fd >= 0) {
+        return ByteOP_remap_up(cake);
+    }
+
     void *new_ptr = realloc_buffer(cake->buffer, cake->capacity, 2);
     if (!new_ptr) {
         return ERROR_REALLOC_FAIL;
@@ -378,7 +945,7 @@ int ByteOP_put(ByteOP *cake, const void *src, const size_t size) {
     VERIFY(cake != NULL);
     VERIFY(src  != NULL);
 
-    if (cake->size + size >= cake->capacity) {
+    while (cake->size + size >= cake->capacity) {
         VERIFY_OK(ByteOP_realloc_up(cake));
     }
 
@@ -419,6 +986,42 @@ int ByteOP_put_string(ByteOP *cake, const char *src) {
     return ByteOP_put(cake, (const void*) src, sizeof(char) * str_len);
 }
 
+int ByteOP_put_u16_le(ByteOP *cake, const uint16_t src) {
+    const byte bytes[2] = {(byte) src, (byte) (src >> 8)};
+    return ByteOP_put(cake, bytes, sizeof(bytes));
+}
+
+int ByteOP_put_u32_le(ByteOP *cake, const uint32_t src) {
+    const byte bytes[4] = {(byte) src, (byte) (src >> 8), (byte) (src >> 16), (byte) (src >> 24)};
+    return ByteOP_put(cake, bytes, sizeof(bytes));
+}
+
+int ByteOP_put_u64_le(ByteOP *cake, const uint64_t src) {
+    byte bytes[8] = {};
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = (byte) (src >> (8 * i));
+    }
+    return ByteOP_put(cake, bytes, sizeof(bytes));
+}
+
+/// LEB128: 7 bits per byte, low groups first, high bit set on every byte but the last
+int ByteOP_put_varint(ByteOP *cake, uint64_t src) {
+    byte bytes[10] = {};
+    size_t len = 0;
+    while (src >= 0x80) {
+        bytes[len++] = (byte) (src | 0x80);
+        src >>= 7;
+    }
+    bytes[len++] = (byte) src;
+
+    return ByteOP_put(cake, bytes, len);
+}
+
+/// zigzag, so small negative numbers stay short too
+int ByteOP_put_varint_signed(ByteOP *cake, const int64_t src) {
+    return ByteOP_put_varint(cake, ((uint64_t) src << 1) ^ (uint64_t) (src >> 63));
+}
+
 int ByteOP_to_file(const ByteOP *cake, const char* filename) {
     VERIFY(cake != NULL);
     FILE *fout = fopen(filename, "wb");
@@ -436,6 +1039,7 @@ typedef struct ByteIP_t {
     size_t cur_idx;
     size_t size;
     byte *buffer;
+    int is_mapped; ///< buffer is a read-only mapping of a file, see new_ByteIP_mmap
 } ByteIP;
 
 ByteIP *new_ByteIP(const size_t capacity) {
@@ -456,8 +1060,48 @@ ByteIP *new_ByteIP(const size_t capacity) {
     return bip;
 }
 
+/// ByteIP reading file_name right from its mapping, nothing is copied.
+/// The mapping is private: buffer can be written to, the file never changes.
+ByteIP *new_ByteIP_mmap(const char *file_name) {
+    ByteIP *bip = calloc(sizeof(ByteIP), 1);
+    if (!bip) {
+        return NULL;
+    }
+
+    const int fd = open(file_name, O_RDONLY);
+    struct stat info = {};
+    if (fd < 0 || fstat(fd, &info)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(bip);
+        return NULL;
+    }
+
+    bip->size = (size_t) info.st_size;
+    bip->capacity = bip->size;
+    bip->is_mapped = 1;
+    if (bip->size) {
+        bip->buffer = mmap(NULL, bip->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (bip->buffer == MAP_FAILED) {
+        free(bip);
+        return NULL;
+    }
+
+    return bip;
+}
+
 int delete_ByteIP(ByteIP *cake) {
-    free(cake->buffer);
+    if (cake->is_mapped) {
+        if (cake->buffer) {
+            munmap(cake->buffer, cake->size);
+        }
+    } else {
+        free(cake->buffer);
+    }
 
     cake->buffer = (byte*) KCTF_POISON;
     cake->capacity = (size_t) KCTF_POISON;
@@ -472,6 +1116,7 @@ int delete_ByteIP(ByteIP *cake) {
 int ByteIP_read_file(ByteIP *cake, const char *file_name, const size_t file_size) {
     VERIFY(cake != NULL);
     VERIFY(file_name != NULL);
+    VERIFY(!cake->is_mapped);
 
     if (file_size > cake->capacity) {
         byte *new_buffer = realloc(cake->buffer, file_size + 1);
@@ -518,6 +1163,20 @@ int ByteIP_get(ByteIP *cake, void *dest, const size_t size) {
     }
 }
 
+/// Zero-copy get: *dest points into the buffer, valid while cake lives
+int ByteIP_get_ptr(ByteIP *cake, const byte **dest, const size_t size) {
+    VERIFY(cake != NULL);
+    VERIFY(dest != NULL);
+
+    if (cake->cur_idx + size > cake->size) {
+        return ERROR_ERROR;
+    }
+
+    *dest = &cake->buffer[cake->cur_idx];
+    cake->cur_idx += size;
+    return 0;
+}
+
 int ByteIP_get_byte(ByteIP *cake, byte *dest) {
     return ByteIP_get(cake, dest, sizeof(byte));
 }
@@ -542,6 +1201,62 @@ int ByteIP_get_double(ByteIP *cake, double *dest) {
     return ByteIP_get(cake, dest, sizeof(double));
 }
 
+int ByteIP_get_u16_le(ByteIP *cake, uint16_t *dest) {
+    const byte *bytes = NULL;
+    if (ByteIP_get_ptr(cake, &bytes, 2)) {
+        return ERROR_ERROR;
+    }
+    *dest = (uint16_t) (bytes[0] | bytes[1] << 8);
+    return 0;
+}
+
+int ByteIP_get_u32_le(ByteIP *cake, uint32_t *dest) {
+    const byte *bytes = NULL;
+    if (ByteIP_get_ptr(cake, &bytes, 4)) {
+        return ERROR_ERROR;
+    }
+    *dest = (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+    return 0;
+}
+
+int ByteIP_get_u64_le(ByteIP *cake, uint64_t *dest) {
+    const byte *bytes = NULL;
+    if (ByteIP_get_ptr(cake, &bytes, 8)) {
+        return ERROR_ERROR;
+    }
+    *dest = 0;
+    for (int i = 0; i < 8; ++i) {
+        *dest |= (uint64_t) bytes[i] << (8 * i);
+    }
+    return 0;
+}
+
+int ByteIP_get_varint(ByteIP *cake, uint64_t *dest) {
+    VERIFY(cake != NULL);
+    VERIFY(dest != NULL);
+
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && cake->cur_idx < cake->size; shift += 7) {
+        const byte cur = cake->buffer[cake->cur_idx++];
+        result |= (uint64_t) (cur & 0x7F) << shift;
+        if (!(cur & 0x80)) {
+            *dest = result;
+            return 0;
+        }
+    }
+
+    return ERROR_ERROR;
+}
+
+int ByteIP_get_varint_signed(ByteIP *cake, int64_t *dest) {
+    uint64_t zigzag = 0;
+    if (ByteIP_get_varint(cake, &zigzag)) {
+        return ERROR_ERROR;
+    }
+    *dest = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+    return 0;
+}
+
 //=============================================================================
 ///<KCTF> Handmade stringview =================================================
 typedef struct Line_t {
@@ -560,9 +1275,9 @@ typedef struct File_t {
 } File;
 
 /**
-    \brief Quadratic sort
+    \brief Introsort
 
-    Sorts array on-place with given comparator
+    Sorts array on-place with given comparator in O(n log n), O(n) if it is already sorted. Not stable
 
     \param[in] arr array which needs to be sorted
     \param[in] elem_cnt count of elements, [0, elem_cnt) will be sorted
@@ -689,21 +1404,186 @@ void swap_ptrs(void **first, void **second) {
     *first = tmp;
 }
 
-void qqh_sort(void *input_arr, const size_t elem_cnt, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)) {
-    assert(input_arr);
-    assert(comp);
+// Introsort: quicksort with a median of 3 sampled pivot, heapsort once recursion gets deeper than 2 * log2(n),
+// insertion sort below KCTF_SORT_INSERTION elements. A partition that swapped nothing
+// tries to finish both halves with an insertion sort of at most KCTF_SORT_PARTIAL_MOVES moves,
+// so sorted and almost sorted input takes O(n) comparisons.
+//
+// KCTF_SORT_DEFINE(name, type, less) generates static void name(type *arr, size_t cnt),
+// less(const type *a, const type *b) can be a macro or a static inline function and gets inlined.
+// qqh_sort is the same algorithm on void* with a runtime elem_size.
+
+#define KCTF_SORT_INSERTION     16
+#define KCTF_SORT_PARTIAL_MOVES 8
+
+static inline void kctf_sort_swap_bytes(void *first, void *second, size_t elem_size) {
+    unsigned char *a = (unsigned char*) first;
+    unsigned char *b = (unsigned char*) second;
+    for (; elem_size >= sizeof(size_t); elem_size -= sizeof(size_t), a += sizeof(size_t), b += sizeof(size_t)) {
+        size_t tmp = 0;
+        memcpy(&tmp, a, sizeof(size_t));
+        memcpy(a, b, sizeof(size_t));
+        memcpy(b, &tmp, sizeof(size_t));
+    }
+    for (; elem_size; --elem_size, ++a, ++b) {
+        const unsigned char tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
 
-    char *arr = (char*) input_arr;
+/// Three pivot candidates first <= mid <= last, pseudo-random but fixed for a given cnt:
+/// fixed positions like 0, cnt / 2, cnt - 1 keep hitting equal keys on periodic input (a text repeated many times)
+static inline void kctf_sort_pick3(const size_t cnt, size_t *first, size_t *mid, size_t *last) {
+    unsigned long long rnd = (unsigned long long) cnt * 0x9E3779B97F4A7C15ull | 1;
+    size_t picks[3] = {};
+    for (int i = 0; i < 3; ++i) {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+        picks[i] = (size_t) (rnd % cnt);
+    }
 
-    for (size_t i = 0; i < elem_cnt; ++i) {
-        for (size_t j = 0; j < elem_cnt - 1; ++j) {
-            void *first = arr + j * elem_size;
-            void *second = arr + (j + 1) * elem_size;
-            if (comp(first, second) > 0) {
-                swap_ptrs((void**) first, (void**) second);
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 2 - i; ++j) {
+            if (picks[j] > picks[j + 1]) {
+                const size_t tmp = picks[j];
+                picks[j] = picks[j + 1];
+                picks[j + 1] = tmp;
             }
         }
     }
+    *first = picks[0];
+    *mid   = picks[1];
+    *last  = picks[2];
+}
+
+static inline int kctf_sort_depth_limit(size_t cnt) {
+    int depth = 0;
+    for (; cnt > 1; cnt >>= 1) {
+        depth += 2;
+    }
+    return depth;
+}
+
+#define KCTF_SORT_UNPACK(...) __VA_ARGS__
+
+// The algorithm itself, elem_t is the type arr points to, AT(arr, i) is the address of the i-th element,
+// LESS(a, b) and SWAP(a, b) take addresses, params/args are extra parameters passed down the recursion
+#define KCTF_SORT_IMPL(name, elem_t, params, args, AT, LESS, SWAP)                                    \
+static inline void name ## _insertion(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) {        \
+    for (size_t i = 1; i < cnt; ++i) {                                                              \
+        for (size_t j = i; j > 0 && LESS(AT(arr, j), AT(arr, j - 1)); --j) {                        \
+            SWAP(AT(arr, j), AT(arr, j - 1));                                                       \
+        }                                                                                           \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static inline int name ## _partial_insertion(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) { \
+    size_t moves = 0;                                                                               \
+    for (size_t i = 1; i < cnt; ++i) {                                                              \
+        for (size_t j = i; j > 0 && LESS(AT(arr, j), AT(arr, j - 1)); --j) {                        \
+            SWAP(AT(arr, j), AT(arr, j - 1));                                                       \
+            if (++moves > KCTF_SORT_PARTIAL_MOVES) {                                                \
+                return 0;                                                                           \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+    return 1;                                                                                       \
+}                                                                                                   \
+                                                                                                    \
+static inline void name ## _sift(elem_t *arr, size_t root, const size_t cnt KCTF_SORT_UNPACK params) { \
+    for (size_t child = 2 * root + 1; child < cnt; root = child, child = 2 * root + 1) {            \
+        if (child + 1 < cnt && LESS(AT(arr, child), AT(arr, child + 1))) {                          \
+            ++child;                                                                                \
+        }                                                                                           \
+        if (!LESS(AT(arr, root), AT(arr, child))) {                                                 \
+            return;                                                                                 \
+        }                                                                                           \
+        SWAP(AT(arr, root), AT(arr, child));                                                        \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static void name ## _heapsort(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) {              \
+    for (size_t i = cnt / 2; i > 0; --i) {                                                          \
+        name ## _sift(arr, i - 1, cnt KCTF_SORT_UNPACK args);                                       \
+    }                                                                                               \
+    for (size_t i = cnt - 1; i > 0; --i) {                                                          \
+        SWAP(AT(arr, 0), AT(arr, i));                                                               \
+        name ## _sift(arr, 0, i KCTF_SORT_UNPACK args);                                             \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static void name ## _intro(elem_t *arr, size_t cnt, int depth KCTF_SORT_UNPACK params) {            \
+    while (cnt > KCTF_SORT_INSERTION) {                                                             \
+        if (depth-- == 0) {                                                                         \
+            name ## _heapsort(arr, cnt KCTF_SORT_UNPACK args);                                      \
+            return;                                                                                 \
+        }                                                                                           \
+                                                                                                    \
+        size_t first = 0, mid = 0, last = 0;                                                        \
+        kctf_sort_pick3(cnt, &first, &mid, &last);                                                  \
+        if (LESS(AT(arr, mid), AT(arr, first))) { SWAP(AT(arr, mid), AT(arr, first)); }             \
+        if (LESS(AT(arr, last), AT(arr, mid)))  { SWAP(AT(arr, last), AT(arr, mid));  }             \
+        if (LESS(AT(arr, mid), AT(arr, first))) { SWAP(AT(arr, mid), AT(arr, first)); }             \
+        if (mid) {                                                                                  \
+            SWAP(AT(arr, 0), AT(arr, mid));                                                         \
+        }                                                                                           \
+                                                                                                    \
+        size_t left = 0, right = cnt;                                                               \
+        int swapped = 0;                                                                            \
+        while (1) {                                                                                 \
+            while (++left < right && LESS(AT(arr, left), AT(arr, 0))) {}                            \
+            while (LESS(AT(arr, 0), AT(arr, --right))) {}                                           \
+            if (left >= right) {                                                                    \
+                break;                                                                              \
+            }                                                                                       \
+            SWAP(AT(arr, left), AT(arr, right));                                                    \
+            swapped = 1;                                                                            \
+        }                                                                                           \
+        SWAP(AT(arr, 0), AT(arr, right));                                                           \
+                                                                                                    \
+        elem_t *upper = AT(arr, right + 1);                                                         \
+        const size_t upper_cnt = cnt - right - 1;                                                   \
+        if (!swapped && name ## _partial_insertion(arr, right KCTF_SORT_UNPACK args)                \
+                     && name ## _partial_insertion(upper, upper_cnt KCTF_SORT_UNPACK args)) {       \
+            return;                                                                                 \
+        }                                                                                           \
+                                                                                                    \
+        if (right < upper_cnt) {                                                                    \
+            name ## _intro(arr, right, depth KCTF_SORT_UNPACK args);                                \
+            arr = upper;                                                                            \
+            cnt = upper_cnt;                                                                        \
+        } else {                                                                                    \
+            name ## _intro(upper, upper_cnt, depth KCTF_SORT_UNPACK args);                          \
+            cnt = right;                                                                            \
+        }                                                                                           \
+    }                                                                                               \
+    name ## _insertion(arr, cnt KCTF_SORT_UNPACK args);                                             \
+}
+
+#define KCTF_SORT_TYPED_AT(arr, i) ((arr) + (i))
+#define KCTF_SORT_TYPED_SWAP(a, b) do {__typeof__(*(a)) kctf_sort_tmp = *(a); *(a) = *(b); *(b) = kctf_sort_tmp;} while (0)
+
+#define KCTF_SORT_DEFINE(name, type, less)                                                          \
+KCTF_SORT_IMPL(name, type, (), (), KCTF_SORT_TYPED_AT, less, KCTF_SORT_TYPED_SWAP)                  \
+                                                                                                    \
+static inline void name(type *arr, const size_t cnt) {                                              \
+    name ## _intro(arr, cnt, kctf_sort_depth_limit(cnt));                                           \
+}
+
+#define KCTF_SORT_BYTES_AT(arr, i) ((arr) + (i) * elem_size)
+#define KCTF_SORT_BYTES_LESS(a, b) (comp(a, b) < 0)
+#define KCTF_SORT_BYTES_SWAP(a, b) kctf_sort_swap_bytes(a, b, elem_size)
+
+KCTF_SORT_IMPL(kctf_sort_bytes, char, (, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)), (, elem_size, comp),
+               KCTF_SORT_BYTES_AT, KCTF_SORT_BYTES_LESS, KCTF_SORT_BYTES_SWAP)
+
+void qqh_sort(void *input_arr, const size_t elem_cnt, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)) {
+    assert(input_arr);
+    assert(comp);
+
+    kctf_sort_bytes_intro((char*) input_arr, elem_cnt, kctf_sort_depth_limit(elem_cnt), elem_size, comp);
 }
 
 void Char_get_next_symb(const unsigned char **c) {
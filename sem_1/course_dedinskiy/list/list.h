@@ -1,4 +1,6 @@
+#include <limits.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "general.h"
 
@@ -6,6 +8,51 @@
 #error LIST_TYPE must be defined to work with KCTF_List
 #endif
 
+// How much every List_* operation checks the list:
+// LIST_CHECK_FULL      - walks the whole list, O(n) per operation
+// LIST_CHECK_AMORTIZED - O(1) checks of fictive links, full walk once per size operations, O(1) amortized
+// LIST_CHECK_NONE      - O(1) checks only, default for KCTF_RELEASE
+#define LIST_CHECK_NONE      0
+#define LIST_CHECK_AMORTIZED 1
+#define LIST_CHECK_FULL      2
+
+#ifndef LIST_VALIDATION
+#ifdef KCTF_RELEASE
+#define LIST_VALIDATION LIST_CHECK_NONE
+#else
+#define LIST_VALIDATION LIST_CHECK_FULL
+#endif
+#endif
+
+// List_linear_index_search relinearizes the list by itself once its slow walks since the last
+// linearization cost more than LIST_RELINEARIZE_COEF * size steps. 0 turns it off.
+// Relinearization renumbers nodes, so turn it off if you hold node indexes across lookups.
+#ifndef LIST_RELINEARIZE_COEF
+#define LIST_RELINEARIZE_COEF 1
+#endif
+
+#if LIST_VALIDATION == LIST_CHECK_FULL
+#define LIST_OK(cake)       VERIFY_OK(List_valid(cake))
+#define LIST_CONST_OK(cake) VERIFY_OK(List_valid(cake))
+#elif LIST_VALIDATION == LIST_CHECK_AMORTIZED
+#define LIST_OK(cake)       VERIFY_OK(List_valid_amortized(cake))
+#define LIST_CONST_OK(cake) VERIFY_OK(List_valid_cheap(cake))
+#else
+#define LIST_OK(cake)       VERIFY_OK(List_valid_cheap(cake))
+#define LIST_CONST_OK(cake) VERIFY_OK(List_valid_cheap(cake))
+#endif
+
+// How the node pool is stored:
+// LIST_LAYOUT_AOS - one Node array, default
+// LIST_LAYOUT_SOA - separate next[], prev[] and data[] arrays, walks touch only next[]
+// Same List_* API either way, reach node fields with LIST_NEXT/LIST_PREV/LIST_DATA
+#define LIST_LAYOUT_AOS 0
+#define LIST_LAYOUT_SOA 1
+
+#ifndef LIST_LAYOUT
+#define LIST_LAYOUT LIST_LAYOUT_AOS
+#endif
+
 struct Node_t;
 typedef struct Node_t {
 	int prev;
@@ -13,8 +60,73 @@ typedef struct Node_t {
 	int next;
 } Node;
 
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+#define LIST_NEXT(cake, node) ((cake)->next[node])
+#define LIST_PREV(cake, node) ((cake)->prev[node])
+#define LIST_DATA(cake, node) ((cake)->data[node])
+#else
+#define LIST_NEXT(cake, node) ((cake)->buffer[node].next)
+#define LIST_PREV(cake, node) ((cake)->buffer[node].prev)
+#define LIST_DATA(cake, node) ((cake)->buffer[node].data)
+#endif
+
+typedef struct ListLookupStats_t {
+	size_t fast_lookups;       ///< index <= max_sorted_index, O(1)
+	size_t slow_lookups;       ///< walked from head
+	size_t slow_steps;         ///< nodes walked by slow lookups since last linearization
+	size_t relinearizations;   ///< done by List_linear_index_search itself
+} ListLookupStats;
+
+// List_graphviz_async_* keeps up to LIST_GRAPHVIZ_RING_SIZE snapshots waiting,
+// dump() blocks when they are all taken, so no snapshot is lost
+#ifndef LIST_GRAPHVIZ_RING_SIZE
+#define LIST_GRAPHVIZ_RING_SIZE 64
+#endif
+
+// how many .gv files one dot call renders
+#ifndef LIST_GRAPHVIZ_BATCH_SIZE
+#define LIST_GRAPHVIZ_BATCH_SIZE 16
+#endif
+
+typedef struct ListGvNode_t {
+	int index;
+	int prev;
+	LIST_TYPE data;
+	int next;
+} ListGvNode;
+
+typedef struct ListGvSnapshot_t {
+	int         dump_index;
+	int         fictive;
+	size_t      nodes_cnt;
+	ListGvNode *nodes;      ///< in list order from head, fictive last
+} ListGvSnapshot;
+
+typedef struct ListGvDumper_t {
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  not_empty;
+	pthread_cond_t  not_full;
+
+	ListGvSnapshot ring[LIST_GRAPHVIZ_RING_SIZE];
+	size_t         ring_head;
+	size_t         ring_size;
+	int            stopping;
+
+	char  *output_file_name;
+	char  *node_format;
+	size_t sample_every;
+	size_t calls;
+} ListGvDumper;
+
 typedef struct List_t {
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	int *next;
+	int *prev;
+	LIST_TYPE *data;
+#else
 	Node *buffer;
+#endif
 	int fictive;
 
 	size_t capacity;
@@ -23,13 +135,23 @@ typedef struct List_t {
 
 	int max_sorted_index;
 
+	ListLookupStats lookup_stats;
+	double relinearize_coef;
+
 	int graphviz_dumper_cnt;
+	ListGvDumper *graphviz_async; ///< NULL - List_graphviz_dump renders right away
+
+	size_t checks_since_full; ///< for LIST_CHECK_AMORTIZED
+
+	void  *pool_mapping;      ///< file mapping the pool lives in after List_load(..., 1), NULL if heap
+	size_t pool_mapping_size;
 } List;
 
 enum LIST_ERROR_CODES {
 	ERROR_BROCKEN_LINKS = -7777,
 	ERROR_UNEXPECTED_LOOP,
 	ERROR_NODE_NOT_IN_LIST,
+	ERROR_THREAD_FAIL,
 };
 
 List *new_List();
@@ -45,43 +167,182 @@ int List_push_back();
 // Implementation =============================================================
 
 int List_head(const List *cake) {
-	return cake->buffer[cake->fictive].next;
+	return LIST_NEXT(cake, cake->fictive);
 }
 
 int List_tail(const List *cake) {
-	return cake->buffer[cake->fictive].prev;
+	return LIST_PREV(cake, cake->fictive);
 }
 
-int List_valid(const List *cake) {
-	//return OK;
+int List_pool_allocated(const List *cake) {
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	return cake->next && cake->prev && cake->data;
+#else
+	return cake->buffer != NULL;
+#endif
+}
+
+// grows or shrinks the pool, contents of the first min(old, new) nodes are kept
+// on failure every array still holds at least min(old, new) nodes
+size_t List_pool_bytes(const size_t capacity) {
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	return capacity * (sizeof(LIST_TYPE) + 2 * sizeof(int));
+#else
+	return capacity * sizeof(Node);
+#endif
+}
+
+// Moves a pool that lives in a file mapping to the heap, so it can be reallocated
+int List_pool_unmap(List *cake) {
+	if (!cake->pool_mapping) {
+		return OK;
+	}
+
+	const size_t capacity = cake->capacity;
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	int *next = (int*) malloc(capacity * sizeof(int));
+	int *prev = (int*) malloc(capacity * sizeof(int));
+	LIST_TYPE *data = (LIST_TYPE*) malloc(capacity * sizeof(LIST_TYPE));
+	if (!next || !prev || !data) {
+		free(next);
+		free(prev);
+		free(data);
+		return ERROR_MALLOC_FAIL;
+	}
+	memcpy(next, cake->next, capacity * sizeof(int));
+	memcpy(prev, cake->prev, capacity * sizeof(int));
+	memcpy(data, cake->data, capacity * sizeof(LIST_TYPE));
+	cake->next = next;
+	cake->prev = prev;
+	cake->data = data;
+#else
+	Node *buffer = (Node*) malloc(capacity * sizeof(Node));
+	if (!buffer) {
+		return ERROR_MALLOC_FAIL;
+	}
+	memcpy(buffer, cake->buffer, capacity * sizeof(Node));
+	cake->buffer = buffer;
+#endif
+
+	munmap(cake->pool_mapping, cake->pool_mapping_size);
+	cake->pool_mapping = NULL;
+	cake->pool_mapping_size = 0;
+
+	return OK;
+}
+
+int List_pool_realloc(List *cake, const size_t capacity) {
+	if (List_pool_unmap(cake) != OK) {
+		return ERROR_REALLOC_FAIL;
+	}
+
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	int *next = (int*) realloc(cake->next, capacity * sizeof(int));
+	if (next) {
+		cake->next = next;
+	}
+	int *prev = (int*) realloc(cake->prev, capacity * sizeof(int));
+	if (prev) {
+		cake->prev = prev;
+	}
+	LIST_TYPE *data = (LIST_TYPE*) realloc(cake->data, capacity * sizeof(LIST_TYPE));
+	if (data) {
+		cake->data = data;
+	}
+
+	if (!next || !prev || !data) {
+		return ERROR_REALLOC_FAIL;
+	}
+#else
+	Node *buffer = (Node*) realloc(cake->buffer, capacity * sizeof(Node));
+	if (!buffer) {
+		return ERROR_REALLOC_FAIL;
+	}
+	cake->buffer = buffer;
+#endif
+
+	return OK;
+}
+
+void List_pool_free(List *cake) {
+	if (cake->pool_mapping) {
+		munmap(cake->pool_mapping, cake->pool_mapping_size);
+		cake->pool_mapping = NULL;
+	} else {
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+		free(cake->next);
+		free(cake->prev);
+		free(cake->data);
+#else
+		free(cake->buffer);
+#endif
+	}
+
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	cake->next = NULL;
+	cake->prev = NULL;
+	cake->data = NULL;
+#else
+	cake->buffer = NULL;
+#endif
+}
+
+int List_valid_cheap(const List *cake) {
 	if (!cake) {
 		RETURNING_VERIFY(ERROR_NULL_OBJECT);
 	}
 
-	if (!cake->buffer) {
+	if (!List_pool_allocated(cake)) {
 		RETURNING_VERIFY(ERROR_NULL_BUFFER);
 	}
 
-	{
-		char *visited = (char*) calloc(cake->capacity, sizeof(char));
-		int head = List_head(cake);
-		for (int i = head; (int) i != cake->fictive; i = cake->buffer[i].next) {
-			if (visited[i]) {
-				RETURNING_VERIFY(ERROR_UNEXPECTED_LOOP);
-			}
-			visited[i] = 1;
-		}
+	if (cake->size >= cake->capacity) {
+		RETURNING_VERIFY(ERROR_BROCKEN_LINKS);
+	}
 
-		int visited_sum = 0;
-		for (size_t i = 0; i < cake->capacity; ++i) {
-			visited_sum += (int) visited[i];
-		}
+	const int head = List_head(cake);
+	const int tail = List_tail(cake);
+	if (head < 0 || (size_t) head >= cake->capacity || tail < 0 || (size_t) tail >= cake->capacity) {
+		RETURNING_VERIFY(ERROR_BROCKEN_LINKS);
+	}
+
+	if (LIST_PREV(cake, head) != cake->fictive || LIST_NEXT(cake, tail) != cake->fictive) {
+		RETURNING_VERIFY(ERROR_BROCKEN_LINKS);
+	}
+
+	return 0;
+}
 
-		if (visited_sum != (int) cake->size) {
-			RETURNING_VERIFY(ERROR_BROCKEN_LINKS);
+int List_valid(const List *cake) {
+	KCTF_PROFILE_SCOPE("List_valid");
+	if (List_valid_cheap(cake) != OK) {
+		return ERROR_CHECK_UPPER_VERIFY;
+	}
+
+	// next is deterministic, so a walk that comes back to fictive in exactly size steps
+	// visited every node once - no visited[] array is needed
+	size_t steps = 0;
+	for (int i = List_head(cake); i != cake->fictive; i = LIST_NEXT(cake, i)) {
+		if (steps++ == cake->size || i < 0 || (size_t) i >= cake->capacity) {
+			RETURNING_VERIFY(ERROR_UNEXPECTED_LOOP);
 		}
+	}
+
+	if (steps != cake->size) {
+		RETURNING_VERIFY(ERROR_BROCKEN_LINKS);
+	}
+
+	return 0;
+}
 
-		free(visited);
+int List_valid_amortized(List *cake) {
+	if (List_valid_cheap(cake) != OK) {
+		return ERROR_CHECK_UPPER_VERIFY;
+	}
+
+	if (++cake->checks_since_full > cake->size) {
+		cake->checks_since_full = 0;
+		return List_valid(cake);
 	}
 
 	return 0;
@@ -95,8 +356,8 @@ List *new_List() {
 		return NULL;
 	}
 
-	l->buffer = (Node*) calloc(cap, sizeof(Node));
-	if (!l->buffer) {
+	if (List_pool_realloc(l, cap) != OK) {
+		List_pool_free(l);
 		free(l);
 		return NULL;
 	}
@@ -107,22 +368,32 @@ List *new_List() {
 	l->free_head = 1;
 
 	for (size_t i = 0; i < cap; ++i) {
-		l->buffer[i].next = (int) i + 1;
-		l->buffer[i].prev = 0;
+		LIST_NEXT(l, i) = (int) i + 1;
+		LIST_PREV(l, i) = 0;
 	}
-	l->buffer[0].next = 0;
+	LIST_NEXT(l, 0) = 0;
 
-	l->max_sorted_index = -1;
+	l->max_sorted_index = 0;
+	l->lookup_stats = (ListLookupStats) {};
+	l->relinearize_coef = LIST_RELINEARIZE_COEF;
 	l->graphviz_dumper_cnt = 0;
+	l->graphviz_async = NULL;
+	l->checks_since_full = 0;
 
 	VERIFY_T(List_valid(l) == OK, List*);
 	return l;
 }
 
+int List_graphviz_async_stop(List *cake);
+
 int delete_List(List *cake) {
-	VERIFY_OK(List_valid(cake));
+	LIST_OK(cake);
+
+	if (cake->graphviz_async) {
+		List_graphviz_async_stop(cake);
+	}
 
-;	free(cake->buffer);
+	List_pool_free(cake);
 	
 	cake->capacity  = (size_t) KCTF_POISON;
 
@@ -136,31 +407,30 @@ int List_dump(const List *cake) {
 
 	int head = List_head(cake);
 	int tail = List_tail(cake);
-	for (int i = head; i != tail; i = cake->buffer[i].next) {
-		printf("[%d](%d) -> ", i, cake->buffer[i].data);
+	for (int i = head; i != tail; i = LIST_NEXT(cake, i)) {
+		printf("[%d](%d) -> ", i, LIST_DATA(cake, i));
 	}
-	printf("[%d](%d)", tail, cake->buffer[tail].data);
+	printf("[%d](%d)", tail, LIST_DATA(cake, tail));
 	printf("\n");
 
 	return 0;
 }
 
 int List_set_capacity(List *cake, const size_t capacity) {
-	VERIFY_OK(List_valid(cake));
+	KCTF_PROFILE_SCOPE("List_set_capacity");
+	LIST_OK(cake);
 
 	if (cake->size >= capacity - 1) {
 		RETURNING_VERIFY(ERROR_REALLOC_FAIL);
 	}
 
-	Node *new_ptr = realloc(cake->buffer, capacity * sizeof(Node));
-	if (!new_ptr) {
+	if (List_pool_realloc(cake, capacity) != OK) {
 		RETURNING_VERIFY(ERROR_REALLOC_FAIL);
 	}
 
-	cake->buffer = new_ptr;
 	for (size_t i = cake->capacity; i < capacity; ++i) {
-		cake->buffer[i].next = (int) i + 1;
-		cake->buffer[i].prev = 0;
+		LIST_NEXT(cake, i) = (int) i + 1;
+		LIST_PREV(cake, i) = 0;
 	}
 	cake->capacity = capacity;
 
@@ -168,15 +438,15 @@ int List_set_capacity(List *cake, const size_t capacity) {
 }
 
 int List_set_node_value(List *cake, const int node, const int left_node, const int right_node, const LIST_TYPE *data) {
-	cake->buffer[node].data = *data;
-	cake->buffer[node].next =  node;
-	cake->buffer[node].prev =  node;
+	LIST_DATA(cake, node) = *data;
+	LIST_NEXT(cake, node) =  node;
+	LIST_PREV(cake, node) =  node;
 
-	cake->buffer[left_node].next = node;
-	cake->buffer[node].prev = left_node;
+	LIST_NEXT(cake, left_node) = node;
+	LIST_PREV(cake, node) = left_node;
 
-	cake->buffer[right_node].prev = node;
-	cake->buffer[node].next = right_node;
+	LIST_PREV(cake, right_node) = node;
+	LIST_NEXT(cake, node) = right_node;
 
 	return 0;
 }
@@ -186,7 +456,7 @@ int List_get_next_free_node(List *cake, int *next_free_node) {
 	if ((size_t) next_free >= cake->capacity - 1) {
 		VERIFY_OK(List_set_capacity(cake, cake->capacity * 2));
 	}
-	cake->free_head = cake->buffer[next_free].next;
+	cake->free_head = LIST_NEXT(cake, next_free);
 
 	*next_free_node = next_free;
 
@@ -194,45 +464,59 @@ int List_get_next_free_node(List *cake, int *next_free_node) {
 }
 
 int List_update_max_sorted(List *cake, const int potential_new_max_sorted) {
-	VERIFY_OK(List_valid(cake));
+	LIST_CONST_OK(cake);
 	int pnms = potential_new_max_sorted; //MAGIC
 	cake->max_sorted_index = pnms < cake->max_sorted_index ? pnms : cake->max_sorted_index;
 
 	return 0;
 }
 
+int List_extend_max_sorted(List *cake, const int new_node) {
+	// everything but new_node was in place and new_node became the tail right at its position
+	const int size = (int) cake->size;
+	if (cake->max_sorted_index == size - 1 && new_node == size && List_tail(cake) == new_node) {
+		cake->max_sorted_index = size;
+	}
+
+	return 0;
+}
+
 int List_push_right(List *cake, int node, LIST_TYPE data) {
-	VERIFY_OK(List_valid(cake));
-	if (cake->buffer[node].prev == (int) KCTF_POISON) {
+	KCTF_PROFILE_SCOPE("List_push_right");
+	LIST_OK(cake);
+	if (LIST_PREV(cake, node) == (int) KCTF_POISON) {
 		RETURNING_VERIFY(ERROR_NODE_NOT_IN_LIST);
 	}
 
 	int next_free = 0;
 	List_get_next_free_node(cake, &next_free);
 
-	int next_node = cake->buffer[node].next;
+	int next_node = LIST_NEXT(cake, node);
 	List_set_node_value(cake, next_free, node, next_node, &data);
 	
 	cake->size += 1;
 	List_update_max_sorted(cake, node);
+	List_extend_max_sorted(cake, next_free);
 
 	return 0;
 }
 
 int List_push_left(List *cake, int node, LIST_TYPE data) {
-	VERIFY_OK(List_valid(cake));
-	if (cake->buffer[node].prev == (int) KCTF_POISON) {
+	KCTF_PROFILE_SCOPE("List_push_left");
+	LIST_OK(cake);
+	if (LIST_PREV(cake, node) == (int) KCTF_POISON) {
 		RETURNING_VERIFY(ERROR_NODE_NOT_IN_LIST);
 	}
 
 	int next_free = 0;
 	List_get_next_free_node(cake, &next_free);
 
-	int prev_node = cake->buffer[node].prev;
+	int prev_node = LIST_PREV(cake, node);
 	List_set_node_value(cake, next_free, prev_node, node, &data);
 	
 	cake->size += 1;
-	List_update_max_sorted(cake, node - 2);
+	List_update_max_sorted(cake, node == cake->fictive ? cake->max_sorted_index : node - 2);
+	List_extend_max_sorted(cake, next_free);
 
 	return 0;
 }
@@ -246,75 +530,518 @@ int List_push_back(List *cake, LIST_TYPE data) {
 }
 
 int List_pop(List *cake, const int node) {
-	VERIFY_OK(List_valid(cake));
+	KCTF_PROFILE_SCOPE("List_pop");
+	LIST_OK(cake);
 	VERIFY(cake->size > 0);
 
-	int next_node = cake->buffer[node].next;
-	int prev_node = cake->buffer[node].prev;
+	int next_node = LIST_NEXT(cake, node);
+	int prev_node = LIST_PREV(cake, node);
 
-	cake->buffer[next_node].prev = prev_node;
-	cake->buffer[prev_node].next = next_node;
+	LIST_PREV(cake, next_node) = prev_node;
+	LIST_NEXT(cake, prev_node) = next_node;
 
 	--cake->size;
 	List_update_max_sorted(cake, node - 1);
 
-	cake->buffer[node].next = cake->free_head;
+	LIST_NEXT(cake, node) = cake->free_head;
 	cake->free_head = node;
 
 	return 0;
 }
 
+// Moves nodes first..last (in list order) right after node after, O(1).
+// after must not be inside first..last, a broken range is caught by the next LIST_OK.
+int List_splice(List *cake, const int first, const int last, const int after) {
+	KCTF_PROFILE_SCOPE("List_splice");
+	LIST_OK(cake);
+	VERIFY(first != cake->fictive && last != cake->fictive && after != last);
+
+	const int prev_node = LIST_PREV(cake, first);
+	const int next_node = LIST_NEXT(cake, last);
+	if (after == prev_node) {
+		return 0;
+	}
+
+	LIST_NEXT(cake, prev_node) = next_node;
+	LIST_PREV(cake, next_node) = prev_node;
+
+	const int after_next = LIST_NEXT(cake, after);
+	LIST_NEXT(cake, after) = first;
+	LIST_PREV(cake, first) = after;
+	LIST_NEXT(cake, last)  = after_next;
+	LIST_PREV(cake, after_next) = last;
+
+	List_update_max_sorted(cake, first - 1);
+	List_update_max_sorted(cake, after);
+
+	return 0;
+}
+
+// Removes nodes first..last (in list order) and gives the whole chain to free list at once.
+// O(k), the walk is only needed to count k.
+int List_erase_range(List *cake, const int first, const int last) {
+	KCTF_PROFILE_SCOPE("List_erase_range");
+	LIST_OK(cake);
+	VERIFY(first != cake->fictive && last != cake->fictive);
+
+	size_t cnt = 1;
+	for (int node = first; node != last; node = LIST_NEXT(cake, node), ++cnt) {
+		if (node == cake->fictive) {
+			RETURNING_VERIFY(ERROR_BAD_ARGS);
+		}
+	}
+
+	const int prev_node = LIST_PREV(cake, first);
+	const int next_node = LIST_NEXT(cake, last);
+	LIST_NEXT(cake, prev_node) = next_node;
+	LIST_PREV(cake, next_node) = prev_node;
+
+	LIST_NEXT(cake, last) = cake->free_head;
+	cake->free_head = first;
+
+	cake->size -= cnt;
+	List_update_max_sorted(cake, first - 1);
+
+	return 0;
+}
+
+int List_clear(List *cake) {
+	KCTF_PROFILE_SCOPE("List_clear");
+	LIST_OK(cake);
+	if (!cake->size) {
+		return 0;
+	}
+
+	LIST_NEXT(cake, List_tail(cake)) = cake->free_head;
+	cake->free_head = List_head(cake);
+
+	LIST_NEXT(cake, cake->fictive) = cake->fictive;
+	LIST_PREV(cake, cake->fictive) = cake->fictive;
+	cake->size = 0;
+	cake->max_sorted_index = 0;
+
+	return 0;
+}
+
+// Takes cnt free nodes with consecutive indexes out of free list, first one goes to *block.
+// Slot capacity - 1 is always free and links to capacity, so free list always ends
+// with the untouched slots and a block can be cut from there.
+// *block is 0 if the pool already has cnt free nodes but not in a row: they should be
+// taken one by one then, growing the pool for a block would leave them unused forever.
+int List_take_free_block(List *cake, const size_t cnt, int *block) {
+	if (cake->max_sorted_index == (int) cake->size) {
+		// nodes are exactly 1..size, everything after them is free: continue linearly
+		const size_t needed = cake->size + cnt + 2;
+		if (cake->capacity < needed) {
+			VERIFY_OK(List_set_capacity(cake, cake->capacity * 2 > needed ? cake->capacity * 2 : needed));
+		}
+
+		*block = (int) cake->size + 1;
+		for (size_t i = cake->size + cnt + 1; i < cake->capacity; ++i) {
+			LIST_NEXT(cake, i) = (int) i + 1;
+		}
+		cake->free_head = (int) (cake->size + cnt + 1);
+	} else if (cake->size + cnt + 2 <= cake->capacity) {
+		*block = 0;
+	} else {
+		const size_t old_capacity = cake->capacity;
+		const size_t needed = old_capacity + cnt + 1;
+		VERIFY_OK(List_set_capacity(cake, old_capacity * 2 > needed ? old_capacity * 2 : needed));
+
+		*block = (int) old_capacity;
+		LIST_NEXT(cake, old_capacity - 1) = (int) (old_capacity + cnt);
+	}
+
+	return 0;
+}
+
+// Links cnt nodes of block after the tail, in index order
+int List_link_block_to_tail(List *cake, const int block, const size_t cnt) {
+	const int tail = List_tail(cake);
+	const int last = block + (int) cnt - 1;
+	for (int node = block; node <= last; ++node) {
+		LIST_PREV(cake, node) = node - 1;
+		LIST_NEXT(cake, node) = node + 1;
+	}
+	LIST_PREV(cake, block) = tail;
+	LIST_NEXT(cake, tail)  = block;
+	LIST_NEXT(cake, last)  = cake->fictive;
+	LIST_PREV(cake, cake->fictive) = last;
+
+	if (cake->max_sorted_index == (int) cake->size && block == (int) cake->size + 1) {
+		cake->max_sorted_index += (int) cnt;
+	}
+	cake->size += cnt;
+
+	return 0;
+}
+
+// Appends cnt elements to the tail, nodes get consecutive indexes so walking them stays linear in memory
+int List_append_array(List *cake, const LIST_TYPE *data, const size_t cnt) {
+	KCTF_PROFILE_SCOPE("List_append_array");
+	LIST_OK(cake);
+	if (!cnt) {
+		return 0;
+	}
+	VERIFY(data != NULL);
+
+	int block = 0;
+	VERIFY_OK(List_take_free_block(cake, cnt, &block));
+	if (!block) {
+		for (size_t i = 0; i < cnt; ++i) {
+			VERIFY_OK(List_push_left(cake, cake->fictive, data[i]));
+		}
+		return 0;
+	}
+	for (size_t i = 0; i < cnt; ++i) {
+		LIST_DATA(cake, block + (int) i) = data[i];
+	}
+	List_link_block_to_tail(cake, block, cnt);
+
+	return 0;
+}
+
+// Moves all of src to the tail of cake, leaving src empty. Lists don't share pools,
+// so data is copied into one consecutive block of cake, O(src->size).
+int List_append_list(List *cake, List *src) {
+	KCTF_PROFILE_SCOPE("List_append_list");
+	LIST_OK(cake);
+	LIST_OK(src);
+	VERIFY(cake != src);
+	if (!src->size) {
+		return 0;
+	}
+
+	int block = 0;
+	VERIFY_OK(List_take_free_block(cake, src->size, &block));
+	if (!block) {
+		for (int node = List_head(src); node != src->fictive; node = LIST_NEXT(src, node)) {
+			VERIFY_OK(List_push_left(cake, cake->fictive, LIST_DATA(src, node)));
+		}
+		return List_clear(src);
+	}
+	int dst_node = block;
+	for (int node = List_head(src); node != src->fictive; node = LIST_NEXT(src, node)) {
+		LIST_DATA(cake, dst_node++) = LIST_DATA(src, node);
+	}
+	List_link_block_to_tail(cake, block, src->size);
+
+	return List_clear(src);
+}
+
+const int LIST_FREE_MARK = -1;
+
+int List_remap_link(const int link, const int a, const int b) {
+	return link == a ? b : (link == b ? a : link);
+}
+
+int List_swap_slots(List *cake, const int a, const int b) {
+	const int b_live = LIST_PREV(cake, b) != LIST_FREE_MARK;
+
+	const int       a_prev = LIST_PREV(cake, a);
+	const int       a_next = LIST_NEXT(cake, a);
+	const LIST_TYPE a_data = LIST_DATA(cake, a);
+	LIST_PREV(cake, a) = LIST_PREV(cake, b);
+	LIST_NEXT(cake, a) = LIST_NEXT(cake, b);
+	LIST_DATA(cake, a) = LIST_DATA(cake, b);
+	LIST_PREV(cake, b) = a_prev;
+	LIST_NEXT(cake, b) = a_next;
+	LIST_DATA(cake, b) = a_data;
+
+	// remap both nodes before touching neighbours, they can be neighbours of each other
+	LIST_PREV(cake, b) = List_remap_link(LIST_PREV(cake, b), a, b);
+	LIST_NEXT(cake, b) = List_remap_link(LIST_NEXT(cake, b), a, b);
+	if (b_live) {
+		LIST_PREV(cake, a) = List_remap_link(LIST_PREV(cake, a), a, b);
+		LIST_NEXT(cake, a) = List_remap_link(LIST_NEXT(cake, a), a, b);
+	}
+
+	LIST_NEXT(cake, LIST_PREV(cake, b)) = b;
+	LIST_PREV(cake, LIST_NEXT(cake, b)) = b;
+	if (b_live) {
+		LIST_NEXT(cake, LIST_PREV(cake, a)) = a;
+		LIST_PREV(cake, LIST_NEXT(cake, a)) = a;
+	}
+
+	return 0;
+}
+
+// Puts node at position i to index i by swapping slots in place and trims capacity to fit.
+// O(size + capacity) time, no second buffer.
 int List_linear_optimization(List *cake) {
-	VERIFY_OK(List_valid(cake));
+	KCTF_PROFILE_SCOPE("List_linear_optimization");
+	LIST_OK(cake);
+
+	for (int i = cake->free_head; (size_t) i < cake->capacity - 1; i = LIST_NEXT(cake, i)) {
+		LIST_PREV(cake, i) = LIST_FREE_MARK;
+	}
+	LIST_PREV(cake, cake->capacity - 1) = LIST_FREE_MARK;
 
-	Node *new_buffer = (Node*) calloc(cake->capacity, sizeof(Node));
-	int node_index = cake->fictive;
-	int inted_size = (int) cake->size;
-	for (int i = 0; i <= inted_size; ++i) {
-		new_buffer[i].data = cake->buffer[node_index].data;
-		new_buffer[i].next = i + 1;
-		new_buffer[i].prev = i - 1;
-		node_index = cake->buffer[node_index].next;
+	// nodes before pos are already in place, so the one at pos is either free or further in the list
+	int node = List_head(cake);
+	for (int pos = 1; node != cake->fictive; ++pos) {
+		if (node != pos) {
+			List_swap_slots(cake, node, pos);
+		}
+		node = LIST_NEXT(cake, pos);
 	}
-	new_buffer[cake->size].next = 0;
-	new_buffer[0].prev = (int) cake->size;
-	free(cake->buffer);
 
-	cake->buffer = new_buffer;
+	const int inted_size = (int) cake->size;
+	size_t capacity = cake->size + 2;
+	if (capacity < STANDART_INIT_SIZE) {
+		capacity = STANDART_INIT_SIZE;
+	}
+	if (capacity < cake->capacity) {
+		// a failed shrink leaves arrays bigger than needed, which is fine
+		List_pool_realloc(cake, capacity);
+		cake->capacity = capacity;
+	}
+
+	for (size_t i = cake->size + 1; i < cake->capacity; ++i) {
+		LIST_NEXT(cake, i) = (int) i + 1;
+		LIST_PREV(cake, i) = 0;
+	}
+	cake->free_head = inted_size + 1;
 
 	cake->max_sorted_index = inted_size;
+	cake->lookup_stats.slow_steps = 0;
 
 	return 0;
 }
 
-int List_linear_index_search(const List *cake, int index) {
-	VERIFY_OK(List_valid(cake));
+int List_set_relinearize_coef(List *cake, const double coef) {
+	LIST_CONST_OK(cake);
+	VERIFY(coef >= 0);
+
+	cake->relinearize_coef = coef;
+	return 0;
+}
+
+int List_linear_index_search(List *cake, int index) {
+	KCTF_PROFILE_SCOPE("List_linear_index_search");
+	LIST_CONST_OK(cake);
 	++index;
-	if (index < 1) {
+	if (index < 1 || (size_t) index > cake->size) {
 		RETURNING_VERIFY(ERROR_BAD_ARGS);
 	}
 
 	if (index <= cake->max_sorted_index) {
+		++cake->lookup_stats.fast_lookups;
 		return index;
+	}
+
+	ListLookupStats *stats = &cake->lookup_stats;
+	// a failed relinearization leaves the list as it was, the slow walk below still works
+	if (cake->relinearize_coef > 0 && (double) stats->slow_steps > cake->relinearize_coef * (double) cake->size
+	    && List_linear_optimization(cake) == OK) {
+		++stats->relinearizations;
+		++stats->fast_lookups;
+		return index;
+	}
+
+	++stats->slow_lookups;
+	stats->slow_steps += (size_t) index;
+
+	int node = List_head(cake);
+	for (int i = 1; i < index; ++i) {
+		node = LIST_NEXT(cake, node);
+	}
+	return node;
+}
+
+int List_dump_lookup_stats(const List *cake) {
+	LIST_CONST_OK(cake);
+
+	const ListLookupStats *stats = &cake->lookup_stats;
+	printf("[DMP]<list>: [fast_lookups](%zu) [slow_lookups](%zu) [slow_steps](%zu) [relinearizations](%zu)\n",
+	       stats->fast_lookups, stats->slow_lookups, stats->slow_steps, stats->relinearizations);
+
+	return 0;
+}
+
+//=============================================================================
+//<KCTF> Saving ===============================================================
+
+// File is a LIST_SAVE_HEADER_SIZE-byte header and then the raw pool, capacity nodes:
+// Node array for LIST_LAYOUT_AOS, data[], next[], prev[] for LIST_LAYOUT_SOA.
+// Native byte order and LIST_TYPE, so it loads back on the same kind of machine only.
+const uint64_t LIST_SAVE_MAGIC       = 0x5453494C4654434Bull; // "KCTFLIST"
+const uint32_t LIST_SAVE_VERSION     = 1;
+const size_t   LIST_SAVE_HEADER_SIZE = 64;                    // keeps the mapped pool aligned
+
+int List_save(List *cake, const char *file_name, const int linearize) {
+	KCTF_PROFILE_SCOPE("List_save");
+	LIST_OK(cake);
+	VERIFY(file_name != NULL);
+
+	if (linearize) {
+		VERIFY_OK(List_linear_optimization(cake));
+	}
+
+	// a pool mapped by List_load can be a private mapping of file_name itself: truncating
+	// the file would turn its untouched pages into zeros, so it goes to the heap first
+	if (List_pool_unmap(cake) != OK) {
+		RETURNING_VERIFY(ERROR_MALLOC_FAIL);
+	}
+
+	const size_t pool_bytes = List_pool_bytes(cake->capacity);
+	ByteOP *bop = new_ByteOP_mmap(file_name, LIST_SAVE_HEADER_SIZE + pool_bytes + 1);
+	if (!bop) {
+		RETURNING_VERIFY(ERROR_FILE_NOT_FOUND);
+	}
+
+	int status = OK;
+	status |= ByteOP_put_u64_le(bop, LIST_SAVE_MAGIC);
+	status |= ByteOP_put_u32_le(bop, LIST_SAVE_VERSION);
+	status |= ByteOP_put_u32_le(bop, LIST_LAYOUT);
+	status |= ByteOP_put_u32_le(bop, (uint32_t) sizeof(LIST_TYPE));
+	status |= ByteOP_put_u32_le(bop, (uint32_t) sizeof(Node));
+	status |= ByteOP_put_u64_le(bop, cake->capacity);
+	status |= ByteOP_put_u64_le(bop, cake->size);
+	status |= ByteOP_put_u32_le(bop, (uint32_t) cake->fictive);
+	status |= ByteOP_put_u32_le(bop, (uint32_t) cake->free_head);
+	status |= ByteOP_put_u32_le(bop, (uint32_t) cake->max_sorted_index);
+
+	while (status == OK && bop->size < LIST_SAVE_HEADER_SIZE) {
+		status |= ByteOP_put_byte(bop, 0);
+	}
+
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+	status |= ByteOP_put(bop, cake->data, cake->capacity * sizeof(LIST_TYPE));
+	status |= ByteOP_put(bop, cake->next, cake->capacity * sizeof(int));
+	status |= ByteOP_put(bop, cake->prev, cake->capacity * sizeof(int));
+#else
+	status |= ByteOP_put(bop, cake->buffer, pool_bytes);
+#endif
+
+	delete_ByteOP(bop);
+	if (status != OK) {
+		RETURNING_VERIFY(ERROR_REALLOC_FAIL);
+	}
+	return 0;
+}
+
+// Returns NULL if file_name is missing or was saved for other LIST_TYPE/LIST_LAYOUT.
+// With map_pool the pool stays in a private mapping of the file: loading is O(1),
+// pages are read on first touch, and the first reallocation moves the pool to the heap.
+// Only O(1) checks are done here, LIST_OK of the next operation does the rest.
+List *List_load(const char *file_name, const int map_pool) {
+	KCTF_PROFILE_SCOPE("List_load");
+	if (!file_name) {
+		return NULL;
+	}
+	ByteIP *bip = new_ByteIP_mmap(file_name);
+	if (!bip) {
+		return NULL;
+	}
+
+	uint64_t magic = 0, capacity = 0, size = 0;
+	uint32_t version = 0, layout = 0, type_size = 0, node_size = 0;
+	uint32_t fictive = 0, free_head = 0, max_sorted_index = 0;
+	ByteIP_get_u64_le(bip, &magic);
+	ByteIP_get_u32_le(bip, &version);
+	ByteIP_get_u32_le(bip, &layout);
+	ByteIP_get_u32_le(bip, &type_size);
+	ByteIP_get_u32_le(bip, &node_size);
+	ByteIP_get_u64_le(bip, &capacity);
+	ByteIP_get_u64_le(bip, &size);
+	ByteIP_get_u32_le(bip, &fictive);
+	ByteIP_get_u32_le(bip, &free_head);
+	ByteIP_get_u32_le(bip, &max_sorted_index);
+
+	// links are ints and the header is used before any other check, so it has to point inside the pool
+	const int header_ok = magic == LIST_SAVE_MAGIC && version == LIST_SAVE_VERSION && layout == LIST_LAYOUT
+	                   && type_size == sizeof(LIST_TYPE) && node_size == sizeof(Node)
+	                   && capacity >= 2 && capacity <= INT_MAX && size < capacity
+	                   && fictive < capacity && free_head > 0 && free_head < capacity && max_sorted_index <= size
+	                   && bip->size == LIST_SAVE_HEADER_SIZE + List_pool_bytes(capacity);
+	List *l = header_ok ? new_List() : NULL;
+	if (!l) {
+		delete_ByteIP(bip);
+		return NULL;
+	}
+
+	List_pool_free(l);
+	bip->cur_idx = LIST_SAVE_HEADER_SIZE;
+	const size_t data_bytes = capacity * sizeof(LIST_TYPE);
+	const size_t link_bytes = capacity * sizeof(int);
+
+	if (map_pool) {
+		byte *pool = bip->buffer + LIST_SAVE_HEADER_SIZE;
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+		l->data = (LIST_TYPE*) pool;
+		l->next = (int*) (pool + data_bytes);
+		l->prev = (int*) (pool + data_bytes + link_bytes);
+#else
+		l->buffer = (Node*) pool;
+#endif
+		l->pool_mapping = bip->buffer;
+		l->pool_mapping_size = bip->size;
+		bip->buffer = NULL; // l owns the mapping now
 	} else {
-		int node = List_head(cake);
-		for (int i = 1; i < index; ++i) {
-			node = cake->buffer[node].next;
+		if (List_pool_realloc(l, capacity) != OK) {
+			List_pool_free(l);
+			free(l);
+			delete_ByteIP(bip);
+			return NULL;
 		}
-		return node;
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+		ByteIP_get(bip, l->data, data_bytes);
+		ByteIP_get(bip, l->next, link_bytes);
+		ByteIP_get(bip, l->prev, link_bytes);
+#else
+		ByteIP_get(bip, l->buffer, List_pool_bytes(capacity));
+#endif
+	}
+	delete_ByteIP(bip);
+
+	l->capacity         = capacity;
+	l->size             = size;
+	l->fictive          = (int) fictive;
+	l->free_head        = (int) free_head;
+	l->max_sorted_index = (int) max_sorted_index;
+
+	if (List_valid_cheap(l) != OK) {
+		List_pool_free(l);
+		free(l);
+		return NULL;
 	}
+
+	return l;
 }
 
-int List_randop(List *cake) {
-	VERIFY_OK(List_valid(cake));
+/// Random push_front/push_back/pop, all choices taken from bits (low 8 - op, next 24 - value, high 32 - index)
+int List_randop_bits(List *cake, const unsigned long long bits) {
+	LIST_OK(cake);
 
-	int roll = rand() % (2 + (cake->size != 0));
+	const int roll  = (int) ((bits & 0xFF) % (cake->size ? 3u : 2u));
+	const int value = (int) ((bits >> 8) & 0xFFFFFF);
 	if (roll == 0) {
-		List_push_front(cake, (LIST_TYPE) rand());
+		List_push_front(cake, (LIST_TYPE) value);
 	} else if (roll == 1) {
-		List_push_back(cake, (LIST_TYPE) rand());
+		List_push_back(cake, (LIST_TYPE) value);
 	} else if (roll == 2 && cake->size) {
-		List_pop(cake, List_linear_index_search(cake, rand() % ((int) cake->size)));
+		List_pop(cake, List_linear_index_search(cake, (int) ((bits >> 32) % cake->size)));
+	}
+
+	return 0;
+}
+
+int List_randop(List *cake) {
+	return List_randop_bits(cake, (unsigned long long) rand() | (unsigned long long) rand() << 32);
+}
+
+/// n random ops with bits from FastRandom_fill, cheaper than n calls of List_randop
+int List_randops(List *cake, FastRandom *rnd, const size_t n) {
+	LIST_OK(cake);
+
+	unsigned long long bits[64];
+	for (size_t done = 0; done < n; done += 64) {
+		const size_t cnt = n - done < 64 ? n - done : 64;
+		FastRandom_fill(rnd, bits, cnt);
+		for (size_t i = 0; i < cnt; ++i) {
+			VERIFY_OK(List_randop_bits(cake, bits[i]));
+		}
 	}
 
 	return 0;
@@ -323,27 +1050,28 @@ int List_randop(List *cake) {
 //=============================================================================
 //<KCTF> Dumping ==============================================================
 
-int List_graphviz_dump_node(List *cake, FILE *fout, char *node_format, const int node) {
-	int next = cake->buffer[node].next;
-	int prev = cake->buffer[node].prev;
+int List_graphviz_write_node(FILE *fout, const char *node_format, const int fictive, const ListGvNode *gv_node) {
+	const int node = gv_node->index;
+	const int next = gv_node->next;
+	const int prev = gv_node->prev;
 
-	if (node == cake->fictive) {
+	if (node == fictive) {
 		fprintf(fout, "node%d[shape=diamond, color=black, label=\"Fictive\"];", node);
 		fprintf(fout, "node%d->node%d:index;\n", node, next);
 		fprintf(fout, "node%d->node%d:index;\n", node, prev);
 		return 0;
 	}
 	
-	fprintf(fout, node_format, node, node, cake->buffer[node].prev, cake->buffer[node].data, cake->buffer[node].next);
+	fprintf(fout, node_format, node, node, prev, gv_node->data, next);
 	fprintf(fout, "\n");
 
-	if (next != cake->fictive) {
+	if (next != fictive) {
 		fprintf(fout, "node%d:next->node%d:index [constraint=true, color=dodgerblue2];\n", node, next);
 	} else {
 		fprintf(fout, "node%d:next->node%d;", node, next);
 	}
 
-	if (prev != cake->fictive) {
+	if (prev != fictive) {
 		fprintf(fout, "node%d:prev->node%d:index [constraint=true, color=crimson];\n", node, prev);
 	} else {
 		fprintf(fout, "node%d:prev->node%d;", node, prev);
@@ -352,6 +1080,11 @@ int List_graphviz_dump_node(List *cake, FILE *fout, char *node_format, const int
 	return 0;
 }
 
+int List_graphviz_dump_node(List *cake, FILE *fout, char *node_format, const int node) {
+	const ListGvNode gv_node = {node, LIST_PREV(cake, node), LIST_DATA(cake, node), LIST_NEXT(cake, node)};
+	return List_graphviz_write_node(fout, node_format, cake->fictive, &gv_node);
+}
+
 int List_graphviz_new_output_name(List *cake, const char *output_file_name, char *output_name) {
 	size_t of_len = strlen(output_file_name);
 	char *output_name_format = (char*) calloc(of_len + 20, sizeof(char));
@@ -366,8 +1099,175 @@ int List_graphviz_new_output_name(List *cake, const char *output_file_name, char
 	return 0;
 }
 
+char *List_graphviz_read_node_format() {
+	char *node_format = (char*) calloc(1000, sizeof(char));
+	
+	FILE *node_format_file = fopen("graphviz_node_format.gv", "r");
+	fread(node_format, sizeof(char), 999, node_format_file);
+	fclose(node_format_file);
+
+	return node_format;
+}
+
+int List_graphviz_write_snapshot(const ListGvDumper *dumper, const ListGvSnapshot *snapshot, char *output_name) {
+	sprintf(output_name, "%s%d", dumper->output_file_name, snapshot->dump_index);
+
+	FILE *dot_file = fopen(output_name, "w");
+	if (!dot_file) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+	fprintf(dot_file, "digraph list {rankdir=\"LR\";\n");
+	for (size_t i = 0; i < snapshot->nodes_cnt; ++i) {
+		List_graphviz_write_node(dot_file, dumper->node_format, snapshot->fictive, &snapshot->nodes[i]);
+	}
+	fprintf(dot_file, "}\n");
+	fclose(dot_file);
+
+	return 0;
+}
+
+// Takes up to LIST_GRAPHVIZ_BATCH_SIZE snapshots at once, writes them and renders all with one dot -O call
+void *List_graphviz_async_worker(void *arg) {
+	ListGvDumper *dumper = (ListGvDumper*) arg;
+
+	ListGvSnapshot batch[LIST_GRAPHVIZ_BATCH_SIZE] = {};
+	const size_t name_len = strlen(dumper->output_file_name) + 20;
+	char *output_name = (char*) calloc(name_len, sizeof(char));
+	char *command     = (char*) calloc(name_len * LIST_GRAPHVIZ_BATCH_SIZE + 20, sizeof(char));
+
+	while (1) {
+		pthread_mutex_lock(&dumper->lock);
+		while (!dumper->ring_size && !dumper->stopping) {
+			pthread_cond_wait(&dumper->not_empty, &dumper->lock);
+		}
+		if (!dumper->ring_size) {
+			pthread_mutex_unlock(&dumper->lock);
+			break;
+		}
+
+		size_t batch_size = 0;
+		while (dumper->ring_size && batch_size < LIST_GRAPHVIZ_BATCH_SIZE) {
+			batch[batch_size++] = dumper->ring[dumper->ring_head];
+			dumper->ring_head = (dumper->ring_head + 1) % LIST_GRAPHVIZ_RING_SIZE;
+			--dumper->ring_size;
+		}
+		pthread_cond_signal(&dumper->not_full);
+		pthread_mutex_unlock(&dumper->lock);
+
+		strcpy(command, "dot -Tsvg -O");
+		for (size_t i = 0; i < batch_size; ++i) {
+			if (List_graphviz_write_snapshot(dumper, &batch[i], output_name) == OK) {
+				strcat(command, " ");
+				strcat(command, output_name);
+			}
+			free(batch[i].nodes);
+		}
+		system(command);
+
+		for (size_t i = 0; i < batch_size; ++i) {
+			sprintf(output_name, "%s%d", dumper->output_file_name, batch[i].dump_index);
+			remove(output_name);
+		}
+	}
+
+	free(output_name);
+	free(command);
+	return NULL;
+}
+
+// From now on List_graphviz_dump only copies every sample_every-th list state into a ring buffer,
+// and a background thread renders them in batches. Stop before List_graphviz_generate_html.
+int List_graphviz_async_start(List *cake, const char *output_file_name, const size_t sample_every) {
+	LIST_OK(cake);
+	VERIFY(!cake->graphviz_async && output_file_name && sample_every > 0);
+
+	ListGvDumper *dumper = (ListGvDumper*) calloc(1, sizeof(ListGvDumper));
+	if (!dumper) {
+		RETURNING_VERIFY(ERROR_MALLOC_FAIL);
+	}
+
+	dumper->output_file_name = strdup(output_file_name);
+	dumper->node_format      = List_graphviz_read_node_format();
+	dumper->sample_every     = sample_every;
+	pthread_mutex_init(&dumper->lock, NULL);
+	pthread_cond_init(&dumper->not_empty, NULL);
+	pthread_cond_init(&dumper->not_full, NULL);
+
+	if (pthread_create(&dumper->thread, NULL, List_graphviz_async_worker, dumper)) {
+		free(dumper->output_file_name);
+		free(dumper->node_format);
+		free(dumper);
+		RETURNING_VERIFY(ERROR_THREAD_FAIL);
+	}
+
+	cake->graphviz_async = dumper;
+	return 0;
+}
+
+// Renders everything still in the ring and joins the thread
+int List_graphviz_async_stop(List *cake) {
+	VERIFY(cake && cake->graphviz_async);
+	ListGvDumper *dumper = cake->graphviz_async;
+
+	pthread_mutex_lock(&dumper->lock);
+	dumper->stopping = 1;
+	pthread_cond_signal(&dumper->not_empty);
+	pthread_mutex_unlock(&dumper->lock);
+
+	pthread_join(dumper->thread, NULL);
+
+	pthread_mutex_destroy(&dumper->lock);
+	pthread_cond_destroy(&dumper->not_empty);
+	pthread_cond_destroy(&dumper->not_full);
+	free(dumper->output_file_name);
+	free(dumper->node_format);
+	free(dumper);
+
+	cake->graphviz_async = NULL;
+	return 0;
+}
+
+int List_graphviz_async_record(List *cake) {
+	ListGvDumper *dumper = cake->graphviz_async;
+	if (dumper->calls++ % dumper->sample_every) {
+		return 0;
+	}
+
+	ListGvSnapshot snapshot = {};
+	snapshot.dump_index = cake->graphviz_dumper_cnt++;
+	snapshot.fictive    = cake->fictive;
+	snapshot.nodes_cnt  = cake->size + 1;
+	snapshot.nodes      = (ListGvNode*) calloc(snapshot.nodes_cnt, sizeof(ListGvNode));
+	if (!snapshot.nodes) {
+		RETURNING_VERIFY(ERROR_MALLOC_FAIL);
+	}
+
+	size_t i = 0;
+	for (int node = List_head(cake); ; node = LIST_NEXT(cake, node)) {
+		snapshot.nodes[i++] = (ListGvNode) {node, LIST_PREV(cake, node), LIST_DATA(cake, node), LIST_NEXT(cake, node)};
+		if (node == cake->fictive) {
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&dumper->lock);
+	while (dumper->ring_size == LIST_GRAPHVIZ_RING_SIZE) {
+		pthread_cond_wait(&dumper->not_full, &dumper->lock);
+	}
+	dumper->ring[(dumper->ring_head + dumper->ring_size) % LIST_GRAPHVIZ_RING_SIZE] = snapshot;
+	++dumper->ring_size;
+	pthread_cond_signal(&dumper->not_empty);
+	pthread_mutex_unlock(&dumper->lock);
+
+	return 0;
+}
+
 int List_graphviz_dump(List *cake, const char *output_file_name) {
-	VERIFY_OK(List_valid(cake));
+	LIST_OK(cake);
+	if (cake->graphviz_async) {
+		return List_graphviz_async_record(cake);
+	}
+
 	const char *tmp_graphviz_file_name = "gv_dump.dt";
 
 	size_t of_len = strlen(output_file_name);
@@ -378,17 +1278,13 @@ int List_graphviz_dump(List *cake, const char *output_file_name) {
 	FILE *dot_file = fopen(tmp_graphviz_file_name, "w");
 	fprintf(dot_file, "digraph list {rankdir=\"LR\";\n");
 
-	char *node_format = (char*) calloc(1000, sizeof(char));
-	
-	FILE *node_format_file = fopen("graphviz_node_format.gv", "r");
-	fread(node_format, sizeof(char), 1000, node_format_file);
-	fclose(node_format_file);
+	char *node_format = List_graphviz_read_node_format();
 
 	//printf("%s\n", node_format);
 
 	int head = List_head(cake);
 	int tail = List_tail(cake);
-	for (int node = head; ; node = cake->buffer[node].next) {
+	for (int node = head; ; node = LIST_NEXT(cake, node)) {
 		List_graphviz_dump_node(cake, dot_file, node_format, node);
 
 		if (node == cake->fictive) {
@@ -0,0 +1,66 @@
+#include <stdlib.h>
+
+// Build with -DLIST_VALIDATION=LIST_CHECK_{FULL,AMORTIZED,NONE}, see "make bench"
+
+#ifndef LIST_BENCH_N
+#define LIST_BENCH_N 10000000
+#endif
+
+#define LIST_TYPE int
+#include "list.h"
+#undef LIST_TYPE
+
+#if LIST_VALIDATION == LIST_CHECK_FULL
+const char *BENCH_MODE = "full";
+#elif LIST_VALIDATION == LIST_CHECK_AMORTIZED
+const char *BENCH_MODE = "amortized";
+#else
+const char *BENCH_MODE = "none";
+#endif
+
+int main() {
+	List *l = new_List();
+
+	TIMER_START();
+	for (int i = 0; i < LIST_BENCH_N; ++i) {
+		if (i % 2) {
+			List_push_back(l, i);
+		} else {
+			List_push_front(l, i);
+		}
+	}
+	TIMER_BREAK();
+	const double push_secs = GLOBAL_TIMER_INTERVAL;
+
+	TIMER_START();
+	while (l->size) {
+		List_pop(l, List_head(l));
+	}
+	TIMER_BREAK();
+	const double pop_secs = GLOBAL_TIMER_INTERVAL;
+
+	printf("[BNC]<list>: [check](%-9s) [n](%d) [push](%9.1lf ns/op) [pop](%9.1lf ns/op)\n",
+	       BENCH_MODE, LIST_BENCH_N, push_secs * 1e9 / LIST_BENCH_N, pop_secs * 1e9 / LIST_BENCH_N);
+
+	int *values = (int*) calloc(LIST_BENCH_N, sizeof(int));
+	for (int i = 0; i < LIST_BENCH_N; ++i) {
+		values[i] = i;
+	}
+
+	TIMER_START();
+	List_append_array(l, values, LIST_BENCH_N);
+	TIMER_BREAK();
+	const double append_secs = GLOBAL_TIMER_INTERVAL;
+
+	TIMER_START();
+	List_erase_range(l, List_head(l), List_tail(l));
+	TIMER_BREAK();
+	const double erase_secs = GLOBAL_TIMER_INTERVAL;
+
+	printf("[BNC]<list>: [check](%-9s) [n](%d) [bulk_append](%9.1lf ns/op) [erase_range](%9.1lf ns/op)\n",
+	       BENCH_MODE, LIST_BENCH_N, append_secs * 1e9 / LIST_BENCH_N, erase_secs * 1e9 / LIST_BENCH_N);
+
+	free(values);
+	delete_List(l);
+	return 0;
+}
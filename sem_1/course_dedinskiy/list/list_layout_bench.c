@@ -0,0 +1,83 @@
+#include <stdlib.h>
+
+// Build with -DLIST_LAYOUT=LIST_LAYOUT_{AOS,SOA} -DLIST_BENCH_TYPE=<type>, see "make bench_layout"
+
+#ifndef LIST_BENCH_TYPE
+#define LIST_BENCH_TYPE int
+#endif
+
+#ifndef LIST_BENCH_N
+#define LIST_BENCH_N (1 << 22)
+#endif
+
+#ifndef LIST_BENCH_REPS
+#define LIST_BENCH_REPS 8
+#endif
+
+#include "general.h"
+// List_dump prints data with %d, the wide types never get there
+#pragma GCC diagnostic ignored "-Wformat"
+
+#define LIST_TYPE LIST_BENCH_TYPE
+#include "list.h"
+#undef LIST_TYPE
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+#if LIST_LAYOUT == LIST_LAYOUT_SOA
+const char *BENCH_LAYOUT = "soa";
+#else
+const char *BENCH_LAYOUT = "aos";
+#endif
+
+double walk_ns_per_node(const List *l, size_t *sink) {
+	TIMER_START();
+	for (int rep = 0; rep < LIST_BENCH_REPS; ++rep) {
+		for (int node = List_head(l); node != l->fictive; node = LIST_NEXT(l, node)) {
+			++*sink;
+		}
+	}
+	TIMER_BREAK();
+	return GLOBAL_TIMER_INTERVAL * 1e9 / LIST_BENCH_N / LIST_BENCH_REPS;
+}
+
+double sum_ns_per_node(const List *l, double *sink) {
+	TIMER_START();
+	for (int rep = 0; rep < LIST_BENCH_REPS; ++rep) {
+		for (int node = List_head(l); node != l->fictive; node = LIST_NEXT(l, node)) {
+			*sink += (double) LIST_DATA(l, node);
+		}
+	}
+	TIMER_BREAK();
+	return GLOBAL_TIMER_INTERVAL * 1e9 / LIST_BENCH_N / LIST_BENCH_REPS;
+}
+
+void bench_list(const List *l, const char *order) {
+	size_t walked = 0;
+	double summed = 0;
+	const double walk_ns = walk_ns_per_node(l, &walked);
+	const double sum_ns  = sum_ns_per_node (l, &summed);
+
+	printf("[BNC]<layout>: [layout](%s) [type](%-11s %2zu B) [order](%-8s) [walk](%6.2lf ns/node) [sum](%6.2lf ns/node) [sink](%zu %.0lf)\n",
+	       BENCH_LAYOUT, STRINGIFY(LIST_BENCH_TYPE), sizeof(LIST_BENCH_TYPE), order, walk_ns, sum_ns, walked, summed);
+}
+
+int main() {
+	List *linear = new_List();
+	for (int i = 0; i < LIST_BENCH_N; ++i) {
+		List_push_front(linear, (LIST_BENCH_TYPE) i);
+	}
+	bench_list(linear, "linear");
+	delete_List(linear);
+
+	// node i goes right after a random earlier node, so list order is a random permutation of the pool
+	List *shuffled = new_List();
+	for (int i = 0; i < LIST_BENCH_N; ++i) {
+		List_push_right(shuffled, rand() % (i + 1), (LIST_BENCH_TYPE) i);
+	}
+	bench_list(shuffled, "shuffled");
+	delete_List(shuffled);
+
+	return 0;
+}
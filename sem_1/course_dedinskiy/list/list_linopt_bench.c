@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// ./list_linopt_bench <n> <inplace|copy>, one mode per process so peak RSS is not shared, see "make bench_linopt"
+
+#define LIST_TYPE int
+#include "list.h"
+#undef LIST_TYPE
+
+#if LIST_LAYOUT != LIST_LAYOUT_AOS
+#error list_linopt_bench compares against the old Node-array code, build it with LIST_LAYOUT_AOS
+#endif
+
+// the calloc-and-copy linearization List_linear_optimization used to be, kept to compare against
+int List_linear_optimization_copy(List *cake) {
+	LIST_OK(cake);
+
+	Node *new_buffer = (Node*) calloc(cake->capacity, sizeof(Node));
+	int node_index = cake->fictive;
+	int inted_size = (int) cake->size;
+	for (int i = 0; i <= inted_size; ++i) {
+		new_buffer[i].data = cake->buffer[node_index].data;
+		new_buffer[i].next = i + 1;
+		new_buffer[i].prev = i - 1;
+		node_index = cake->buffer[node_index].next;
+	}
+	new_buffer[cake->size].next = 0;
+	new_buffer[0].prev = (int) cake->size;
+	for (size_t i = cake->size + 1; i < cake->capacity; ++i) {
+		new_buffer[i].next = (int) i + 1;
+	}
+	free(cake->buffer);
+
+	cake->buffer = new_buffer;
+	cake->free_head = inted_size + 1;
+
+	cake->max_sorted_index = inted_size;
+
+	return 0;
+}
+
+long peak_rss_kb() {
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		printf("usage: %s <n> <inplace|copy>\n", argv[0]);
+		return 1;
+	}
+	const int n = atoi(argv[1]);
+	const int in_place = !strcmp(argv[2], "inplace");
+
+	List *l = new_List();
+	List_set_relinearize_coef(l, 0);
+
+	// zigzag order with every fourth node popped, so nodes are scattered and free list is not linear
+	for (int i = 0; i < n; ++i) {
+		if (i % 2) {
+			List_push_back(l, i);
+		} else {
+			List_push_front(l, i);
+		}
+	}
+	for (int node = List_head(l), i = 0; node != l->fictive; ++i) {
+		const int next = LIST_NEXT(l, node);
+		if (i % 4 == 0) {
+			List_pop(l, node);
+		}
+		node = next;
+	}
+
+	const size_t capacity_before = l->capacity;
+	const long rss_before = peak_rss_kb();
+
+	TIMER_START();
+	if (in_place) {
+		List_linear_optimization(l);
+	} else {
+		List_linear_optimization_copy(l);
+	}
+	TIMER_BREAK();
+
+	const long rss_after = peak_rss_kb();
+
+	int ok = 1;
+	for (int i = 1; i <= (int) l->size && ok; ++i) {
+		ok = LIST_NEXT(l, i) == (i == (int) l->size ? 0 : i + 1);
+	}
+
+	printf("[BNC]<linopt>: [mode](%-7s) [n](%9d) [time](%7.3lf s) [peak_rss](%8ld -> %8ld kB) [capacity](%9zu -> %9zu) [linear](%d)\n",
+	       argv[2], n, GLOBAL_TIMER_INTERVAL, rss_before, rss_after, capacity_before, l->capacity, ok);
+
+	delete_List(l);
+	return 0;
+}
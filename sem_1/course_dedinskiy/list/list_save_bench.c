@@ -0,0 +1,55 @@
+#include <stdlib.h>
+
+// ./list_save_bench <n>: rebuilding a list by pushes vs List_load with and without mapping, see "make bench_save"
+
+#define LIST_TYPE int
+#include "list.h"
+#undef LIST_TYPE
+
+const char *BENCH_FILE_NAME = "list_save_bench.bin";
+
+long long walk_sum(const List *l) {
+	long long sum = 0;
+	for (int node = List_head(l); node != l->fictive; node = LIST_NEXT(l, node)) {
+		sum += LIST_DATA(l, node);
+	}
+	return sum;
+}
+
+int main(int argc, char **argv) {
+	const int n = argc > 1 ? atoi(argv[1]) : 10000000;
+
+	TIMER_START();
+	List *built = new_List();
+	for (int i = 0; i < n; ++i) {
+		List_push_front(built, i);
+	}
+	TIMER_BREAK();
+	const double build_secs = GLOBAL_TIMER_INTERVAL;
+
+	TIMER_START();
+	List_save(built, BENCH_FILE_NAME, 1);
+	TIMER_BREAK();
+	const double save_secs = GLOBAL_TIMER_INTERVAL;
+	const long long expected = walk_sum(built);
+	delete_List(built);
+
+	for (int map_pool = 0; map_pool <= 1; ++map_pool) {
+		TIMER_START();
+		List *loaded = List_load(BENCH_FILE_NAME, map_pool);
+		TIMER_BREAK();
+		const double load_secs = GLOBAL_TIMER_INTERVAL;
+
+		TIMER_START();
+		const long long sum = walk_sum(loaded);
+		TIMER_BREAK();
+		const double walk_secs = GLOBAL_TIMER_INTERVAL;
+
+		printf("[BNC]<list_save>: [n](%d) [push_build](%7.3lf s) [save](%7.3lf s) [load %s](%9.6lf s) [first_walk](%7.3lf s) [same](%d)\n",
+		       n, build_secs, save_secs, map_pool ? "mmap" : "copy", load_secs, walk_secs, sum == expected);
+		delete_List(loaded);
+	}
+
+	remove(BENCH_FILE_NAME);
+	return 0;
+}
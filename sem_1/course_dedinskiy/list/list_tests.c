@@ -1,10 +1,39 @@
 #include "list_tests.h"
 
-int main() {
+// ./list_tests --bench [report.json|report.csv] runs the microbenches instead of the tests
+
+int main(int argc, char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "--bench")) {
+		if (argc > 2 && kctf_bench_report_to(argv[2])) {
+			printf("[ERR]<microbench>: can't open [%s]\n", argv[2]);
+			return ERROR_FILE_NOT_FOUND;
+		}
+
+		KCTF_BENCH_RUN(push_pop_back);
+		KCTF_BENCH_RUN(push_pop_front);
+		KCTF_BENCH_RUN(index_search);
+		KCTF_BENCH_RUN(append_erase_range);
+		KCTF_BENCH_RUN(valid);
+		KCTF_BENCH_RUN(fast_random_rand);
+		KCTF_BENCH_RUN(fast_random_fill_512);
+
+		kctf_bench_report_close();
+		return 0;
+	}
+
 	printf("[TST]<unit_test>: starting\n");
 
 	KCTF_UNIT_TEST_RUN(head_tail);
 	KCTF_UNIT_TEST_RUN(set_capacity);
+	KCTF_UNIT_TEST_RUN(valid_catches_broken_links);
+	KCTF_UNIT_TEST_RUN(index_search_relinearizes);
+	KCTF_UNIT_TEST_RUN(linear_optimization_keeps_order);
+	KCTF_UNIT_TEST_RUN(bulk_operations);
+	KCTF_UNIT_TEST_RUN(append_reuses_free_nodes);
+	KCTF_UNIT_TEST_RUN(byte_io_roundtrip);
+	KCTF_UNIT_TEST_RUN(save_load);
+	KCTF_UNIT_TEST_RUN(fast_random_streams);
+	KCTF_UNIT_TEST_RUN(sort_matches_qsort);
 	
 	printf("[TST]<unit_test>: done\n");
 
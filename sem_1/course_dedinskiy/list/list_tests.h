@@ -7,13 +7,13 @@ const int TEST_LOOP_MAX_ITR = 1000;
 KCTF_UNIT_TEST(head_tail) {
 	List *l = new_List();
 
-	EXPECT_EQ(l->buffer[l->fictive].next, List_head(l));
-	EXPECT_EQ(l->buffer[l->fictive].prev, List_tail(l));
+	EXPECT_EQ(LIST_NEXT(l, l->fictive), List_head(l));
+	EXPECT_EQ(LIST_PREV(l, l->fictive), List_tail(l));
 
 	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
 		List_randop(l);
-		EXPECT_EQ(l->buffer[l->fictive].next, List_head(l));
-		EXPECT_EQ(l->buffer[l->fictive].prev, List_tail(l));
+		EXPECT_EQ(LIST_NEXT(l, l->fictive), List_head(l));
+		EXPECT_EQ(LIST_PREV(l, l->fictive), List_tail(l));
 	}
 
 	delete_List(l);
@@ -30,6 +30,485 @@ KCTF_UNIT_TEST(set_capacity) {
 	delete_List(l);
 }
 
+KCTF_UNIT_TEST(valid_catches_broken_links) {
+	List *l = new_List();
+
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_push_back(l, i);
+	}
+	EXPECT_EQ(List_valid(l), OK);
+
+	int node = List_head(l);
+	for (int i = 0; i < TEST_LOOP_MAX_ITR / 2; ++i) {
+		node = LIST_NEXT(l, node);
+	}
+	const int saved_next = LIST_NEXT(l, node);
+	LIST_NEXT(l, node) = List_head(l);
+	EXPECT_TRUE(List_valid(l) != OK);
+
+	LIST_NEXT(l, node) = saved_next;
+	EXPECT_EQ(List_valid(l), OK);
+
+	delete_List(l);
+}
+
+KCTF_UNIT_TEST(index_search_relinearizes) {
+	List *l = new_List();
+
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_push_front(l, i);
+	}
+	EXPECT_EQ(l->max_sorted_index, TEST_LOOP_MAX_ITR);
+
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		EXPECT_EQ(LIST_DATA(l, List_linear_index_search(l, i)), i);
+	}
+	EXPECT_EQ(l->lookup_stats.slow_lookups, (size_t) 0);
+
+	List_push_back(l, -1);
+	List_set_relinearize_coef(l, 2);
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		const int node = List_linear_index_search(l, i + 1); // may reallocate buffer
+		EXPECT_EQ(LIST_DATA(l, node), i);
+	}
+	EXPECT_EQ(l->lookup_stats.relinearizations, (size_t) 1);
+	EXPECT_EQ(l->max_sorted_index, TEST_LOOP_MAX_ITR + 1);
+
+	List_push_front(l, TEST_LOOP_MAX_ITR);
+	EXPECT_EQ(l->max_sorted_index, TEST_LOOP_MAX_ITR + 2);
+	EXPECT_EQ(List_valid(l), OK);
+	EXPECT_TRUE(List_linear_index_search(l, (int) l->size) < 0);
+
+	delete_List(l);
+}
+
+KCTF_UNIT_TEST(linear_optimization_keeps_order) {
+	List *l = new_List();
+	List_set_relinearize_coef(l, 0);
+
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_randop(l);
+	}
+
+	int *order = (int*) calloc(l->size, sizeof(int));
+	int cnt = 0;
+	for (int node = List_head(l); node != l->fictive; node = LIST_NEXT(l, node)) {
+		order[cnt++] = LIST_DATA(l, node);
+	}
+
+	List_linear_optimization(l);
+	EXPECT_EQ(List_valid(l), OK);
+	EXPECT_EQ(l->capacity, l->size + 2 < STANDART_INIT_SIZE ? STANDART_INIT_SIZE : l->size + 2);
+
+	for (int i = 0; i < cnt; ++i) {
+		EXPECT_EQ(LIST_DATA(l, i + 1), order[i]);
+		EXPECT_EQ(List_linear_index_search(l, i), i + 1);
+	}
+
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_randop(l);
+	}
+	EXPECT_EQ(List_valid(l), OK);
+
+	free(order);
+	delete_List(l);
+}
+
+int List_expect_order(List *l, const int *order, const int cnt) {
+	EXPECT_EQ(List_valid(l), OK);
+	EXPECT_EQ(l->size, (size_t) cnt);
+
+	int i = 0;
+	for (int node = List_head(l); node != l->fictive && i < cnt; node = LIST_NEXT(l, node), ++i) {
+		EXPECT_EQ(LIST_DATA(l, node), order[i]);
+	}
+	EXPECT_EQ(i, cnt);
+
+	return 0;
+}
+
+KCTF_UNIT_TEST(bulk_operations) {
+	List *l = new_List();
+	List_set_relinearize_coef(l, 0);
+
+	const int values[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	List_append_array(l, values, 10);
+	List_expect_order(l, values, 10);
+	EXPECT_EQ(l->max_sorted_index, 10);
+
+	// 1..3 after 7
+	List_splice(l, 2, 4, 8);
+	const int spliced[] = {0, 4, 5, 6, 7, 1, 2, 3, 8, 9};
+	List_expect_order(l, spliced, 10);
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_EQ(LIST_DATA(l, List_linear_index_search(l, i)), spliced[i]);
+	}
+
+	// 5 6 7 1
+	List_erase_range(l, 6, 2);
+	const int erased[] = {0, 4, 2, 3, 8, 9};
+	List_expect_order(l, erased, 6);
+
+	List_append_array(l, values, 3);
+	const int appended[] = {0, 4, 2, 3, 8, 9, 0, 1, 2};
+	List_expect_order(l, appended, 9);
+
+	List *src = new_List();
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_randop(src);
+	}
+	const int src_size = (int) src->size;
+	int *merged = (int*) calloc(9 + src->size, sizeof(int));
+	memcpy(merged, appended, sizeof(appended));
+	int cnt = 9;
+	for (int node = List_head(src); node != src->fictive; node = LIST_NEXT(src, node)) {
+		merged[cnt++] = LIST_DATA(src, node);
+	}
+
+	List_append_list(l, src);
+	List_expect_order(l, merged, 9 + src_size);
+	EXPECT_EQ(src->size, (size_t) 0);
+	EXPECT_EQ(List_valid(src), OK);
+
+	List_push_front(src, 1);
+	List_push_front(src, 2);
+	EXPECT_EQ(List_valid(src), OK);
+
+	List_clear(l);
+	List_expect_order(l, values, 0);
+	List_append_array(l, values, 10);
+	List_expect_order(l, values, 10);
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_randop(l);
+	}
+	EXPECT_EQ(List_valid(l), OK);
+
+	free(merged);
+	delete_List(src);
+	delete_List(l);
+}
+
+KCTF_UNIT_TEST(append_reuses_free_nodes) {
+	List *l = new_List();
+	List_set_relinearize_coef(l, 0);
+	for (int i = 0; i < 10; ++i) {
+		List_push_back(l, i);
+	}
+	List_pop(l, List_head(l));
+	EXPECT_TRUE(l->max_sorted_index != (int) l->size);
+
+	const int value = 7;
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_append_array(l, &value, 1);
+		List_pop(l, List_tail(l));
+	}
+	EXPECT_EQ(l->size, (size_t) 9);
+	EXPECT_TRUE(l->capacity <= 64);
+
+	int values[100] = {};
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_append_array(l, values, 100);
+		List_erase_range(l, List_linear_index_search(l, 9), List_tail(l));
+	}
+	EXPECT_EQ(l->size, (size_t) 9);
+	EXPECT_TRUE(l->capacity <= 512);
+	EXPECT_EQ(List_valid(l), OK);
+
+	delete_List(l);
+}
+
+KCTF_UNIT_TEST(byte_io_roundtrip) {
+	const char *file_name = "byte_io_test.bin";
+	const int64_t values[] = {0, 1, -1, 127, 128, -300, 1ll << 40, INT64_MAX, INT64_MIN};
+	const size_t values_cnt = sizeof(values) / sizeof(values[0]);
+
+	ByteOP *bop = new_ByteOP_mmap(file_name, 4);
+	for (size_t i = 0; i < values_cnt; ++i) {
+		ByteOP_put_varint_signed(bop, values[i]);
+		ByteOP_put_u64_le(bop, (uint64_t) values[i]);
+		ByteOP_put_u32_le(bop, (uint32_t) values[i]);
+		ByteOP_put_u16_le(bop, (uint16_t) values[i]);
+	}
+	delete_ByteOP(bop);
+
+	ByteIP *bip = new_ByteIP_mmap(file_name);
+	EXPECT_TRUE(bip != NULL);
+	for (size_t i = 0; i < values_cnt; ++i) {
+		int64_t  varint = 0;
+		uint64_t u64 = 0;
+		uint32_t u32 = 0;
+		uint16_t u16 = 0;
+		EXPECT_EQ(ByteIP_get_varint_signed(bip, &varint), OK);
+		EXPECT_EQ(ByteIP_get_u64_le(bip, &u64), OK);
+		EXPECT_EQ(ByteIP_get_u32_le(bip, &u32), OK);
+		EXPECT_EQ(ByteIP_get_u16_le(bip, &u16), OK);
+		EXPECT_EQ(varint, values[i]);
+		EXPECT_EQ(u64, (uint64_t) values[i]);
+		EXPECT_EQ(u32, (uint32_t) values[i]);
+		EXPECT_EQ(u16, (uint16_t) values[i]);
+	}
+	EXPECT_EQ(bip->cur_idx, bip->size);
+
+	uint64_t past_end = 0;
+	EXPECT_TRUE(ByteIP_get_varint(bip, &past_end) != OK);
+
+	delete_ByteIP(bip);
+	remove(file_name);
+}
+
+KCTF_UNIT_TEST(save_load) {
+	const char *file_name = "list_save_test.bin";
+	List *l = new_List();
+	List_set_relinearize_coef(l, 0);
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_randop(l);
+	}
+
+	int *order = (int*) calloc(l->size, sizeof(int));
+	int cnt = 0;
+	for (int node = List_head(l); node != l->fictive; node = LIST_NEXT(l, node)) {
+		order[cnt++] = LIST_DATA(l, node);
+	}
+
+	for (int map_pool = 0; map_pool <= 1; ++map_pool) {
+		EXPECT_EQ(List_save(l, file_name, 0), OK);
+		List *loaded = List_load(file_name, map_pool);
+		EXPECT_TRUE(loaded != NULL);
+		EXPECT_EQ(loaded->capacity, l->capacity);
+		EXPECT_EQ(loaded->free_head, l->free_head);
+		EXPECT_EQ(loaded->max_sorted_index, l->max_sorted_index);
+		EXPECT_EQ(loaded->pool_mapping != NULL, map_pool);
+		List_expect_order(loaded, order, cnt);
+
+		// grows past capacity, so a mapped pool has to move to the heap
+		const int pushes = 2 * (int) loaded->capacity;
+		for (int i = 0; i < pushes; ++i) {
+			List_push_front(loaded, i);
+		}
+		EXPECT_TRUE(loaded->pool_mapping == NULL);
+		EXPECT_EQ(List_valid(loaded), OK);
+		delete_List(loaded);
+	}
+
+	EXPECT_EQ(List_save(l, file_name, 1), OK);
+	List *loaded = List_load(file_name, 1);
+	EXPECT_EQ(loaded->max_sorted_index, cnt);
+	for (int i = 0; i < cnt; ++i) {
+		EXPECT_EQ(LIST_DATA(loaded, List_linear_index_search(loaded, i)), order[i]);
+	}
+
+	// saved over the file its pool is mapped from
+	EXPECT_EQ(List_save(loaded, file_name, 0), OK);
+	List_expect_order(loaded, order, cnt);
+	delete_List(loaded);
+	loaded = List_load(file_name, 1);
+	EXPECT_TRUE(loaded != NULL);
+	List_expect_order(loaded, order, cnt);
+	delete_List(loaded);
+
+	// fictive out of the pool
+	FILE *patched = fopen(file_name, "r+b");
+	fseek(patched, 40, SEEK_SET);
+	const uint32_t bad_fictive = 0xFFFFFFF0u;
+	fwrite(&bad_fictive, sizeof(bad_fictive), 1, patched);
+	fclose(patched);
+	EXPECT_TRUE(List_load(file_name, 1) == NULL);
+
+	FILE *garbage = fopen(file_name, "wb");
+	fprintf(garbage, "not a list");
+	fclose(garbage);
+	EXPECT_TRUE(List_load(file_name, 1) == NULL);
+	EXPECT_TRUE(List_load("no_such_file.bin", 0) == NULL);
+
+	remove(file_name);
+	free(order);
+	delete_List(l);
+}
+
+KCTF_UNIT_TEST(fast_random_streams) {
+	const unsigned long long seed = (unsigned long long) randlong() | 1;
+
+	FastRandom *stepped = new_FastRandom(seed);
+	FastRandom *jumped  = new_FastRandom(seed);
+	for (int i = 0; i < 1 << 10; ++i) {
+		FastRandom_rand(stepped);
+	}
+	FastRandom_jump(jumped, 10);
+	EXPECT_EQ(stepped->rnd, jumped->rnd);
+
+	const size_t n = 4 * FAST_RANDOM_LANES + 3;
+	unsigned long long bits[4 * FAST_RANDOM_LANES + 3] = {};
+	FastRandom_fill(jumped, bits, n);
+	for (int lane = 0; lane < FAST_RANDOM_LANES; ++lane) {
+		FastRandom *scalar = new_FastRandom(FastRandom_jump_state(stepped->rnd, FAST_RANDOM_LANE_LOG2));
+		for (int k = 0; k < lane; ++k) {
+			FastRandom_jump(scalar, FAST_RANDOM_LANE_LOG2);
+		}
+		for (size_t i = (size_t) lane; i < n; i += FAST_RANDOM_LANES) {
+			EXPECT_EQ(bits[i], FastRandom_rand(scalar));
+		}
+		delete_FastRandom(scalar);
+	}
+
+	FastRandom *first  = new_FastRandom_stream(seed, 1);
+	FastRandom *second = new_FastRandom_stream(seed, 2);
+	FastRandom_jump(first, FAST_RANDOM_STREAM_LOG2);
+	EXPECT_EQ(first->rnd, second->rnd);
+
+	List *l = new_List();
+	EXPECT_EQ(List_randops(l, second, (size_t) TEST_LOOP_MAX_ITR), OK);
+	EXPECT_EQ(List_valid(l), OK);
+
+	delete_List(l);
+	delete_FastRandom(first);
+	delete_FastRandom(second);
+	delete_FastRandom(stepped);
+	delete_FastRandom(jumped);
+}
+
+int compare_ints(const void *elem1, const void *elem2) {
+	const int first  = *(const int*) elem1;
+	const int second = *(const int*) elem2;
+	return (first > second) - (first < second);
+}
+
+#define LESS_INTS(a, b) (*(a) < *(b))
+KCTF_SORT_DEFINE(sort_ints, int, LESS_INTS)
+
+typedef struct Triple_t {
+	unsigned char key;
+	unsigned char pad[2];
+} Triple;
+
+int compare_triples(const void *elem1, const void *elem2) {
+	return (int) ((const Triple*) elem1)->key - (int) ((const Triple*) elem2)->key;
+}
+
+KCTF_UNIT_TEST(sort_matches_qsort) {
+	const size_t cnt = (size_t) TEST_LOOP_MAX_ITR;
+	int *arr   = (int*) calloc(cnt, sizeof(int));
+	int *typed = (int*) calloc(cnt, sizeof(int));
+	int *ref   = (int*) calloc(cnt, sizeof(int));
+
+	// random, few distinct, sorted, reversed
+	for (int pattern = 0; pattern < 4; ++pattern) {
+		for (size_t i = 0; i < cnt; ++i) {
+			const int values[] = {rand(), rand() % 4, (int) i, (int) (cnt - i)};
+			arr[i] = values[pattern];
+		}
+		memcpy(typed, arr, cnt * sizeof(int));
+		memcpy(ref,   arr, cnt * sizeof(int));
+
+		qsort   (ref, cnt, sizeof(int), compare_ints);
+		qqh_sort(arr, cnt, sizeof(int), compare_ints);
+		sort_ints(typed, cnt);
+		EXPECT_EQ(memcmp(arr,   ref, cnt * sizeof(int)), 0);
+		EXPECT_EQ(memcmp(typed, ref, cnt * sizeof(int)), 0);
+	}
+
+	const size_t triples_cnt = cnt / 4;
+	Triple *triples = (Triple*) calloc(triples_cnt, sizeof(Triple));
+	for (size_t i = 0; i < triples_cnt; ++i) {
+		triples[i].key = (unsigned char) rand();
+		triples[i].pad[0] = triples[i].pad[1] = triples[i].key;
+	}
+	qqh_sort(triples, triples_cnt, sizeof(Triple), compare_triples);
+	for (size_t i = 0; i < triples_cnt; ++i) {
+		EXPECT_TRUE(i == 0 || triples[i - 1].key <= triples[i].key);
+		EXPECT_TRUE(triples[i].pad[0] == triples[i].key && triples[i].pad[1] == triples[i].key);
+	}
+
+	free(triples);
+	free(arr);
+	free(typed);
+	free(ref);
+}
+
 KCTF_UNIT_TEST(fail) {
 	EXPECT_TRUE(0);
-}
\ No newline at end of file
+}
+
+KCTF_BENCH(push_pop_back) {
+	List *l = new_List();
+
+	KCTF_BENCH_LOOP {
+		List_push_back(l, 1);
+		List_pop(l, List_tail(l));
+	}
+
+	delete_List(l);
+}
+
+KCTF_BENCH(push_pop_front) {
+	List *l = new_List();
+
+	KCTF_BENCH_LOOP {
+		List_push_front(l, 1);
+		List_pop(l, List_head(l));
+	}
+
+	delete_List(l);
+}
+
+KCTF_BENCH(index_search) {
+	List *l = new_List();
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_push_back(l, i);
+	}
+
+	int index = 0;
+	KCTF_BENCH_LOOP {
+		KCTF_DO_NOT_OPTIMIZE(List_linear_index_search(l, index));
+		index = (index + 1) % TEST_LOOP_MAX_ITR;
+	}
+
+	delete_List(l);
+}
+
+KCTF_BENCH(append_erase_range) {
+	List *l = new_List();
+	int values[64] = {};
+
+	KCTF_BENCH_LOOP {
+		List_append_array(l, values, 64);
+		List_erase_range(l, List_head(l), List_tail(l));
+	}
+
+	delete_List(l);
+}
+
+KCTF_BENCH(valid) {
+	List *l = new_List();
+	for (int i = 0; i < TEST_LOOP_MAX_ITR; ++i) {
+		List_push_back(l, i);
+	}
+
+	KCTF_BENCH_LOOP {
+		KCTF_DO_NOT_OPTIMIZE(List_valid(l));
+	}
+
+	delete_List(l);
+}
+
+KCTF_BENCH(fast_random_rand) {
+	FastRandom *rnd = new_FastRandom(1);
+
+	KCTF_BENCH_LOOP {
+		KCTF_DO_NOT_OPTIMIZE(FastRandom_rand(rnd));
+	}
+
+	delete_FastRandom(rnd);
+}
+
+KCTF_BENCH(fast_random_fill_512) {
+	FastRandom *rnd = new_FastRandom(1);
+	unsigned long long bits[512];
+	FastRandom_fill(rnd, bits, 512);
+
+	KCTF_BENCH_LOOP {
+		FastRandom_fill(rnd, bits, 512);
+		KCTF_CLOBBER_MEMORY();
+	}
+
+	delete_FastRandom(rnd);
+}
@@ -17,6 +17,10 @@ int main() {
 	
 	printf("Pushing\n");
 
+	// snapshots are rendered by a background thread in batches, DUMP_EVERY-th operation only
+	const size_t DUMP_EVERY = 1;
+	List_graphviz_async_start(l, "gv_dump_", DUMP_EVERY);
+
 	TIMER_START();
 	for (int i = 1; i <= N; ++i) {
 		int roll = rand() % 3;
@@ -35,6 +39,7 @@ int main() {
 	List_linear_optimization(l);
 	TIMER_END_AND_PRINT();
 
+	List_graphviz_async_stop(l);
 	List_graphviz_generate_html(l, "gv_dump_");
 	//List_dump(l);
 
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+
+// ./sort_bench n: sorts n random Line* by compare_lines_letters with qsort, qqh_sort and
+// KCTF_SORT_DEFINE, random and already sorted, see "make bench_sort"
+
+#include "general.h"
+
+#define LESS_LINES(a, b) (compare_lines_letters(a, b) < 0)
+KCTF_SORT_DEFINE(sort_lines, Line*, LESS_LINES)
+
+const size_t BENCH_LINE_LEN = 24;
+
+typedef enum BenchSort_t {
+    SORT_QSORT,
+    SORT_QQH,
+    SORT_TYPED,
+} BenchSort;
+
+const char *SORT_NAMES[] = {"qsort", "qqh_sort", "typed"};
+
+double bench_sort(Line **lines, const Line **initial, const size_t n, const BenchSort sort) {
+    memcpy(lines, initial, n * sizeof(Line*));
+
+    TIMER_START();
+    if (sort == SORT_QSORT) {
+        qsort(lines, n, sizeof(Line*), compare_lines_letters);
+    } else if (sort == SORT_QQH) {
+        qqh_sort(lines, n, sizeof(Line*), compare_lines_letters);
+    } else {
+        sort_lines(lines, n);
+    }
+    TIMER_BREAK();
+
+    for (size_t i = 1; i < n; ++i) {
+        VERIFY(compare_lines_letters(&lines[i - 1], &lines[i]) <= 0);
+    }
+    return GLOBAL_TIMER_INTERVAL;
+}
+
+int main(int argc, char **argv) {
+    const size_t n = argc > 1 ? (size_t) atoll(argv[1]) : 100000;
+
+    // onegin-like lines: letters, spaces and some punctuation compare_lines_letters has to skip
+    unsigned char *text  = (unsigned char*) calloc(n, BENCH_LINE_LEN + 1);
+    Line          *pool  = (Line*)          calloc(n, sizeof(Line));
+    Line         **lines = (Line**)         calloc(n, sizeof(Line*));
+    const Line   **initial = (const Line**) calloc(n, sizeof(Line*));
+    VERIFY(text && pool && lines && initial);
+
+    FastRandom *rnd = new_FastRandom(n);
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char *string = text + i * (BENCH_LINE_LEN + 1);
+        for (size_t j = 0; j < BENCH_LINE_LEN; ++j) {
+            const size_t roll = (size_t) (FastRandom_rand(rnd) >> 32);
+            string[j] = roll % 8 == 0 ? (unsigned char) " ,.!"[roll / 8 % 4] : (unsigned char) ('a' + roll / 8 % 26);
+        }
+        pool[i].string = string;
+        pool[i].len    = BENCH_LINE_LEN;
+        initial[i]     = &pool[i];
+    }
+
+    for (int sorted = 0; sorted < 2; ++sorted) {
+        for (int sort = SORT_QSORT; sort <= SORT_TYPED; ++sort) {
+            const double secs = bench_sort(lines, initial, n, (BenchSort) sort);
+            printf("[BNC]<sort>: [n](%9zu) [input](%-6s) [sort](%-8s) [time](%8.3lf s) [per line](%7.1lf ns)\n",
+                   n, sorted ? "sorted" : "random", SORT_NAMES[sort], secs, secs * 1e9 / (double) n);
+        }
+        memcpy(initial, lines, n * sizeof(Line*));
+    }
+
+    delete_FastRandom(rnd);
+    free(initial);
+    free(lines);
+    free(pool);
+    free(text);
+    return 0;
+}
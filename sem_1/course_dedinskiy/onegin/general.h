@@ -17,6 +17,16 @@ NOTES:
 #define KCTF_GENERAL_H
 
 #include <assert.h>
+#include <limits.h>
+
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 //<KCTF> Everyday_staff =======================================================
 
@@ -45,6 +55,7 @@ enum RETURN_CODES {
     ERROR_NULL_OBJECT,
     ERROR_NO_RET_CODE,
     ERROR_BAD_ARGS,
+    ERROR_NO_RHYMES,
     NULL_OBJ_OK = 0,
     RET_OK = 0,
 };
@@ -61,8 +72,12 @@ enum CURRENT_PROJECT_SETTINGS { // special for Onegin
 struct Line {
     unsigned char *string;
     size_t len;
-    int index; // for debug !#!@#@!#@!#@!#
+    size_t index; ///< position of the line in the file, equal keys are ordered by it
     unsigned char ending[RHYME_DEPTH + 1]; // special for Onegin
+    const unsigned char *key;        ///< countable letters of string only, see build_sort_keys
+    size_t key_len;
+    unsigned long long key_prefix;   ///< first 8 bytes of key, big-endian, zero-padded
+    unsigned long long key_suffix;   ///< same for key read from the end
 };
 
 /// Typedef for Line
@@ -76,15 +91,21 @@ struct File {
     unsigned char *text;
     size_t lines_cnt;
     Line_t **lines;
+    Line_t *line_pool;    ///< all lines in one array if the file is read by map_file
+    size_t pool_capacity;
+    size_t mapping_size;  ///< text is a mapping of the file if not 0
+    unsigned char *tail;  ///< copy of the last line if the file does not end with '\n'
+    unsigned char *keys;  ///< all Line_t::key, see build_sort_keys
+    size_t keys_size;
 };
 
 /// Typedef for File
 typedef struct File File_t;
 
 /**
-    \brief Quadratic sort
+    \brief Introsort
 
-    Sorts array on-place with given comparator
+    Sorts array on-place with given comparator in O(n log n), O(n) if it is already sorted. Not stable
 
     \param[in] arr array which needs to be sorted
     \param[in] elem_cnt count of elements, [0, elem_cnt) will be sorted
@@ -103,6 +124,27 @@ void qqh_sort(void *arr, const size_t elem_cnt, const size_t elem_size, int (*co
 */
 int compare_lines_letters(const void *elem1, const void *elem2);
 
+/**
+    \brief Comparator for two lines with keys built by build_sort_keys
+
+    Same order as compare_lines_letters, but compares 8 letters at once and never skips punctuation.
+    Lines with equal keys are ordered by index, so every correct sort gives the same result
+
+    \param[in] elem1,elem2 elements to compare
+    \return an int <0 if elem1<elem2, 0 if elem1=elem2, >0 if elem1>elem2
+*/
+int compare_lines_keys(const void *elem1, const void *elem2);
+
+/**
+    \brief Comparator for two lines by their keys read from the end
+
+    Rhyme order of keys built by build_sort_keys, lines with equal keys are ordered by index
+
+    \param[in] elem1,elem2 elements to compare
+    \return an int <0 if elem1<elem2, 0 if elem1=elem2, >0 if elem1>elem2
+*/
+int compare_lines_keys_suffix(const void *elem1, const void *elem2);
+
 /**
     \brief Reversed comparator for two lines
 
@@ -143,6 +185,101 @@ int read_file(File_t *file, const char *name);
 */
 int read_lines(File_t *file);
 
+/**
+    \brief Maps file into memory and indexes its lines
+
+    No copy of the text is made: the file is mapped copy-on-write and '\n' are replaced with '\0' in place.
+    Lines are found in one pass with memchr and all Line_t records live in one array (line_pool).
+    Freed by free_memory_file as usual
+
+    \param[in] file object to be read to
+    \param[in] name - filename to be read from
+    \return 0 if file is mapped successfully, else error code <0
+*/
+int map_file(File_t *file, const char *name);
+
+/**
+    \brief Maps file window by window and calls process for each one
+
+    For files that do not fit into memory: at most window_size bytes are mapped at once.
+    window holds only the lines of the current window, they are valid until process returns,
+    Line_t::index counts from the start of the file. A line longer than a window is ERROR_BIG_FILE
+
+    \param[in] name - filename to be read from
+    \param[in] window_size bytes to map at once, rounded up to the mapping granularity
+    \param[in] process called for every window, a non-zero return stops the scan and is returned
+    \param[in] ctx passed to process as is
+    \return 0 if all the file is processed, else error code
+*/
+int map_file_windows(const char *name, const size_t window_size, int (*process)(File_t *window, void *ctx), void *ctx);
+
+/**
+    \brief Splits text into lines
+
+    Appends one Line_t per line of text[0, size) to file->line_pool. Every line must end with '\n',
+    except for the last one, which then needs text[size] to be writable
+
+    \param[in] file object to append lines to
+    \param[in] text,size text to split
+    \param[in] first_index index of the first line
+    \return 0 if text is indexed successfully, else error code <0
+*/
+int index_lines(File_t *file, unsigned char *text, const size_t size, const size_t first_index);
+
+/**
+    \brief Builds normalized sort keys for all lines of file
+
+    Every line gets its countable letters packed into file->keys once, so sorting with compare_lines_keys
+    (or sort_lines_by_key) does not normalize the same line log n times. Rebuilt from scratch on every call
+
+    \param[in] file object with lines indexed
+    \return 0 if keys are built successfully, else error code <0
+*/
+int build_sort_keys(File_t *file);
+
+/**
+    \brief Sorts lines by keys in several threads
+
+    Sample sort: splitters from an even sample cut lines into one bucket per thread,
+    threads place their part of lines into buckets and sort one bucket each with sort_lines_by_key.
+    Gives the same order as sort_lines_by_key, keys must be built by build_sort_keys
+
+    \param[in] lines,cnt lines to sort
+    \param[in] threads number of threads, at most PARALLEL_SORT_MAX_THREADS, 1 sorts in the calling thread.
+                       Work of a thread that can not be started is done by the calling thread
+    \return 0 if lines are sorted successfully, ERROR_MALLOC_FAIL otherwise
+*/
+int parallel_sort_lines_by_key(Line_t **lines, const size_t cnt, size_t threads);
+
+/**
+    \brief Multikey quicksort of lines by keys
+
+    Partitions lines by 8 letters of key at a time (three-way, Bentley-Sedgewick), so every letter
+    is looked at about log n times in total instead of once per comparison, the first 8 come from key_prefix/key_suffix.
+    suffix_order reads keys from the end, which is compare_lines_keys_suffix (rhyme) order, nothing is reversed in memory.
+    Gives the same order as sorting with compare_lines_keys / compare_lines_keys_suffix, keys must be built by build_sort_keys
+
+    \param[in] lines,cnt lines to sort
+    \param[in] suffix_order 0 for compare_lines_keys order, 1 for compare_lines_keys_suffix order
+*/
+void string_sort_lines(Line_t **lines, const size_t cnt, const int suffix_order);
+
+/**
+    \brief Sorts a file that does not fit into memory
+
+    Reads fin_name with map_file_windows, sorts every window with sort_lines_by_key and spills it into a run file
+    next to fout_name (fout_name.N.run), then merges runs EXTERNAL_SORT_MAX_WAYS at a time with a heap of their
+    current lines until one is left. Lines are written as print_file does, in the order of compare_lines_keys.
+    memory_budget is shared by a window (1/EXTERNAL_SORT_WINDOW_SHARE of it), its Line_t records and keys,
+    which fits lines of 16 bytes or longer on average; the merge uses half of it for read buffers and a quarter for writing
+
+    \param[in] fin_name file to sort
+    \param[in] fout_name file to write sorted lines into
+    \param[in] memory_budget bytes, at least EXTERNAL_SORT_MIN_BUDGET
+    \return 0 if file is sorted successfully, else error code <0
+*/
+int external_sort_file(const char *fin_name, const char *fout_name, const size_t memory_budget);
+
 /**
     \brief Prints file into given file
 
@@ -202,21 +339,188 @@ void swap_ptrs(void **first, void **second) {
     *first = tmp;
 }
 
-void qqh_sort(void *arr, const size_t elem_cnt, const size_t elem_size,
-              int (*comp)(const void *elem1, const void *elem2)) {
+// Introsort: quicksort with a median of 3 sampled pivot, heapsort once recursion gets deeper than 2 * log2(n),
+// insertion sort below KCTF_SORT_INSERTION elements. A partition that swapped nothing
+// tries to finish both halves with an insertion sort of at most KCTF_SORT_PARTIAL_MOVES moves,
+// so sorted and almost sorted input takes O(n) comparisons.
+//
+// KCTF_SORT_DEFINE(name, type, less) generates static void name(type *arr, size_t cnt),
+// less(const type *a, const type *b) can be a macro or a static inline function and gets inlined.
+// qqh_sort is the same algorithm on void* with a runtime elem_size.
+
+#define KCTF_SORT_INSERTION     16
+#define KCTF_SORT_PARTIAL_MOVES 8
+
+static inline void kctf_sort_swap_bytes(void *first, void *second, size_t elem_size) {
+    unsigned char *a = (unsigned char*) first;
+    unsigned char *b = (unsigned char*) second;
+    for (; elem_size >= sizeof(size_t); elem_size -= sizeof(size_t), a += sizeof(size_t), b += sizeof(size_t)) {
+        size_t tmp = 0;
+        memcpy(&tmp, a, sizeof(size_t));
+        memcpy(a, b, sizeof(size_t));
+        memcpy(b, &tmp, sizeof(size_t));
+    }
+    for (; elem_size; --elem_size, ++a, ++b) {
+        const unsigned char tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
 
-    assert(arr);
-    //assert(comp) ???
-
-    for (int i = 0; i < elem_cnt; ++i) {
-        for (int j = 0; j < elem_cnt - 1; ++j) {
-            void *first = arr + j * elem_size;
-            void *second = arr + (j + 1) * elem_size;
-            if (comp(first, second) > 0) {
-                swap_ptrs(first, second);
+/// Three pivot candidates first <= mid <= last, pseudo-random but fixed for a given cnt:
+/// fixed positions like 0, cnt / 2, cnt - 1 keep hitting equal keys on periodic input (a text repeated many times)
+static inline void kctf_sort_pick3(const size_t cnt, size_t *first, size_t *mid, size_t *last) {
+    unsigned long long rnd = (unsigned long long) cnt * 0x9E3779B97F4A7C15ull | 1;
+    size_t picks[3] = {};
+    for (int i = 0; i < 3; ++i) {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+        picks[i] = (size_t) (rnd % cnt);
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 2 - i; ++j) {
+            if (picks[j] > picks[j + 1]) {
+                const size_t tmp = picks[j];
+                picks[j] = picks[j + 1];
+                picks[j + 1] = tmp;
             }
         }
     }
+    *first = picks[0];
+    *mid   = picks[1];
+    *last  = picks[2];
+}
+
+static inline int kctf_sort_depth_limit(size_t cnt) {
+    int depth = 0;
+    for (; cnt > 1; cnt >>= 1) {
+        depth += 2;
+    }
+    return depth;
+}
+
+#define KCTF_SORT_UNPACK(...) __VA_ARGS__
+
+// The algorithm itself, elem_t is the type arr points to, AT(arr, i) is the address of the i-th element,
+// LESS(a, b) and SWAP(a, b) take addresses, params/args are extra parameters passed down the recursion
+#define KCTF_SORT_IMPL(name, elem_t, params, args, AT, LESS, SWAP)                                    \
+static inline void name ## _insertion(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) {        \
+    for (size_t i = 1; i < cnt; ++i) {                                                              \
+        for (size_t j = i; j > 0 && LESS(AT(arr, j), AT(arr, j - 1)); --j) {                        \
+            SWAP(AT(arr, j), AT(arr, j - 1));                                                       \
+        }                                                                                           \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static inline int name ## _partial_insertion(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) { \
+    size_t moves = 0;                                                                               \
+    for (size_t i = 1; i < cnt; ++i) {                                                              \
+        for (size_t j = i; j > 0 && LESS(AT(arr, j), AT(arr, j - 1)); --j) {                        \
+            SWAP(AT(arr, j), AT(arr, j - 1));                                                       \
+            if (++moves > KCTF_SORT_PARTIAL_MOVES) {                                                \
+                return 0;                                                                           \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+    return 1;                                                                                       \
+}                                                                                                   \
+                                                                                                    \
+static inline void name ## _sift(elem_t *arr, size_t root, const size_t cnt KCTF_SORT_UNPACK params) { \
+    for (size_t child = 2 * root + 1; child < cnt; root = child, child = 2 * root + 1) {            \
+        if (child + 1 < cnt && LESS(AT(arr, child), AT(arr, child + 1))) {                          \
+            ++child;                                                                                \
+        }                                                                                           \
+        if (!LESS(AT(arr, root), AT(arr, child))) {                                                 \
+            return;                                                                                 \
+        }                                                                                           \
+        SWAP(AT(arr, root), AT(arr, child));                                                        \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static void name ## _heapsort(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) {              \
+    for (size_t i = cnt / 2; i > 0; --i) {                                                          \
+        name ## _sift(arr, i - 1, cnt KCTF_SORT_UNPACK args);                                       \
+    }                                                                                               \
+    for (size_t i = cnt - 1; i > 0; --i) {                                                          \
+        SWAP(AT(arr, 0), AT(arr, i));                                                               \
+        name ## _sift(arr, 0, i KCTF_SORT_UNPACK args);                                             \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static void name ## _intro(elem_t *arr, size_t cnt, int depth KCTF_SORT_UNPACK params) {            \
+    while (cnt > KCTF_SORT_INSERTION) {                                                             \
+        if (depth-- == 0) {                                                                         \
+            name ## _heapsort(arr, cnt KCTF_SORT_UNPACK args);                                      \
+            return;                                                                                 \
+        }                                                                                           \
+                                                                                                    \
+        size_t first = 0, mid = 0, last = 0;                                                        \
+        kctf_sort_pick3(cnt, &first, &mid, &last);                                                  \
+        if (LESS(AT(arr, mid), AT(arr, first))) { SWAP(AT(arr, mid), AT(arr, first)); }             \
+        if (LESS(AT(arr, last), AT(arr, mid)))  { SWAP(AT(arr, last), AT(arr, mid));  }             \
+        if (LESS(AT(arr, mid), AT(arr, first))) { SWAP(AT(arr, mid), AT(arr, first)); }             \
+        if (mid) {                                                                                  \
+            SWAP(AT(arr, 0), AT(arr, mid));                                                         \
+        }                                                                                           \
+                                                                                                    \
+        size_t left = 0, right = cnt;                                                               \
+        int swapped = 0;                                                                            \
+        while (1) {                                                                                 \
+            while (++left < right && LESS(AT(arr, left), AT(arr, 0))) {}                            \
+            while (LESS(AT(arr, 0), AT(arr, --right))) {}                                           \
+            if (left >= right) {                                                                    \
+                break;                                                                              \
+            }                                                                                       \
+            SWAP(AT(arr, left), AT(arr, right));                                                    \
+            swapped = 1;                                                                            \
+        }                                                                                           \
+        SWAP(AT(arr, 0), AT(arr, right));                                                           \
+                                                                                                    \
+        elem_t *upper = AT(arr, right + 1);                                                         \
+        const size_t upper_cnt = cnt - right - 1;                                                   \
+        if (!swapped && name ## _partial_insertion(arr, right KCTF_SORT_UNPACK args)                \
+                     && name ## _partial_insertion(upper, upper_cnt KCTF_SORT_UNPACK args)) {       \
+            return;                                                                                 \
+        }                                                                                           \
+                                                                                                    \
+        if (right < upper_cnt) {                                                                    \
+            name ## _intro(arr, right, depth KCTF_SORT_UNPACK args);                                \
+            arr = upper;                                                                            \
+            cnt = upper_cnt;                                                                        \
+        } else {                                                                                    \
+            name ## _intro(upper, upper_cnt, depth KCTF_SORT_UNPACK args);                          \
+            cnt = right;                                                                            \
+        }                                                                                           \
+    }                                                                                               \
+    name ## _insertion(arr, cnt KCTF_SORT_UNPACK args);                                             \
+}
+
+#define KCTF_SORT_TYPED_AT(arr, i) ((arr) + (i))
+#define KCTF_SORT_TYPED_SWAP(a, b) do {__typeof__(*(a)) kctf_sort_tmp = *(a); *(a) = *(b); *(b) = kctf_sort_tmp;} while (0)
+
+#define KCTF_SORT_DEFINE(name, type, less)                                                          \
+KCTF_SORT_IMPL(name, type, (), (), KCTF_SORT_TYPED_AT, less, KCTF_SORT_TYPED_SWAP)                  \
+                                                                                                    \
+static inline void name(type *arr, const size_t cnt) {                                              \
+    name ## _intro(arr, cnt, kctf_sort_depth_limit(cnt));                                           \
+}
+
+#define KCTF_SORT_BYTES_AT(arr, i) ((arr) + (i) * elem_size)
+#define KCTF_SORT_BYTES_LESS(a, b) (comp(a, b) < 0)
+#define KCTF_SORT_BYTES_SWAP(a, b) kctf_sort_swap_bytes(a, b, elem_size)
+
+KCTF_SORT_IMPL(kctf_sort_bytes, char, (, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)), (, elem_size, comp),
+               KCTF_SORT_BYTES_AT, KCTF_SORT_BYTES_LESS, KCTF_SORT_BYTES_SWAP)
+
+void qqh_sort(void *arr, const size_t elem_cnt, const size_t elem_size,
+              int (*comp)(const void *elem1, const void *elem2)) {
+
+    assert(arr);
+    assert(comp);
+
+    kctf_sort_bytes_intro((char*) arr, elem_cnt, kctf_sort_depth_limit(elem_cnt), elem_size, comp);
 }
 
 void get_next_letter(unsigned char **c) {
@@ -252,9 +556,926 @@ int reverse_compare_lines_letters(const void **elem1, const void **elem2) {
     return -compare_lines_letters(elem1, elem2);
 }
 
+//=============================================================================
+// Mapped files
+
+size_t map_granularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return (size_t) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+int get_file_size(const char *name, unsigned long long *size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data = {};
+    if (!GetFileAttributesExA(name, GetFileExInfoStandard, &data)) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    *size = ((unsigned long long) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat info = {};
+    if (stat(name, &info)) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    *size = (unsigned long long) info.st_size;
+#endif
+    return 0;
+}
+
+/// Copy-on-write mapping of [offset, offset + len) of the file, offset must be a multiple of map_granularity()
+unsigned char *map_file_region(const char *name, const unsigned long long offset, const size_t len) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    void *view = NULL;
+    if (mapping) {
+        view = MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD) (offset >> 32), (DWORD) offset, len);
+        CloseHandle(mapping); // the view keeps the mapping alive
+    }
+    CloseHandle(file);
+    return (unsigned char*) view;
+#else
+    const int fd = open(name, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    void *view = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) offset);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return NULL;
+    }
+
+    madvise(view, len, MADV_SEQUENTIAL);
+    return (unsigned char*) view;
+#endif
+}
+
+void unmap_file_region(unsigned char *view, const size_t len) {
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+#else
+    munmap(view, len);
+#endif
+}
+
+int index_lines(File_t *file, unsigned char *text, const size_t size, const size_t first_index) {
+    assert(file);
+    assert(text || !size);
+
+    unsigned char *c = text;
+    unsigned char *end = text + size;
+    while (c < end) {
+        unsigned char *line_end = (unsigned char*) memchr(c, '\n', (size_t) (end - c));
+        if (!line_end) {
+            line_end = end;
+        }
+
+        if (file->lines_cnt == file->pool_capacity) {
+            const size_t capacity = file->pool_capacity ? file->pool_capacity * 2 : 1024;
+            Line_t *pool = (Line_t*) realloc(file->line_pool, capacity * sizeof(Line_t));
+            if (!pool) {
+                return ERROR_MALLOC_FAIL;
+            }
+            file->line_pool = pool;
+            file->pool_capacity = capacity;
+        }
+
+        size_t len = (size_t) (line_end - c);
+        if (len && c[len - 1] == '\r') {
+            --len;
+        }
+        c[len] = '\0';
+
+        Line_t *line = &file->line_pool[file->lines_cnt];
+        memset(line, 0, sizeof(Line_t));
+        line->string = c;
+        line->len    = len;
+        line->index  = first_index + file->lines_cnt;
+        ++file->lines_cnt;
+
+        c = line_end + 1;
+    }
+
+    return 0;
+}
+
+/// Indexes text, the part after the last '\n' is copied into file->tail if is_last, left for the next window otherwise.
+/// *consumed is how many bytes of text are indexed
+int index_text(File_t *file, unsigned char *text, const size_t size, const int is_last, const size_t first_index, size_t *consumed) {
+    size_t body = size;
+    while (body && text[body - 1] != '\n') {
+        --body;
+    }
+
+    if (!is_last && !body) {
+        return ERROR_BIG_FILE;
+    }
+
+    int ret = index_lines(file, text, body, first_index);
+    if (ret < 0 || !is_last || body == size) {
+        *consumed = body;
+        return ret;
+    }
+
+    file->tail = (unsigned char*) calloc(size - body + 1, sizeof(char));
+    if (!file->tail) {
+        return ERROR_MALLOC_FAIL;
+    }
+    memcpy(file->tail, text + body, size - body);
+
+    *consumed = size;
+    return index_lines(file, file->tail, size - body, first_index);
+}
+
+/// Fills file->lines with pointers into file->line_pool
+int link_lines(File_t *file) {
+    Line_t **lines = (Line_t**) realloc(file->lines, (file->lines_cnt + 1) * sizeof(Line_t*));
+    if (!lines) {
+        return ERROR_MALLOC_FAIL;
+    }
+
+    file->lines = lines;
+    for (size_t i = 0; i < file->lines_cnt; ++i) {
+        file->lines[i] = &file->line_pool[i];
+    }
+    return 0;
+}
+
+int map_file(File_t *file, const char *name) {
+    assert(file);
+    assert(name);
+
+    file->name = name;
+
+    unsigned long long size = 0;
+    int ret = get_file_size(name, &size);
+    if (ret < 0) {
+        return ret;
+    }
+    if (size > (size_t) -1 / 2) {
+        return ERROR_BIG_FILE;
+    }
+
+    if (size) {
+        file->text = map_file_region(name, 0, (size_t) size);
+        if (!file->text) {
+            return ERROR_BIG_FILE;
+        }
+        file->mapping_size = (size_t) size;
+    }
+
+    size_t consumed = 0;
+    ret = index_text(file, file->text, (size_t) size, 1, 0, &consumed);
+    if (ret < 0) {
+        return ret;
+    }
+    return link_lines(file);
+}
+
+int map_file_windows(const char *name, const size_t window_size, int (*process)(File_t *window, void *ctx), void *ctx) {
+    assert(name);
+    assert(process);
+
+    unsigned long long size = 0;
+    int ret = get_file_size(name, &size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    const size_t granularity = map_granularity();
+    size_t window = (window_size + granularity - 1) / granularity * granularity;
+    if (window < 2 * granularity) {
+        window = 2 * granularity;
+    }
+
+    File_t cur = {};
+    cur.name = name;
+
+    unsigned long long line_start = 0;
+    size_t lines_done = 0;
+    while (line_start < size && ret == 0) {
+        const unsigned long long aligned = line_start - line_start % granularity;
+        const size_t skip = (size_t) (line_start - aligned);
+        const int is_last = size - aligned <= window;
+        const size_t len = is_last ? (size_t) (size - aligned) : window;
+
+        unsigned char *view = map_file_region(name, aligned, len);
+        if (!view) {
+            ret = ERROR_BIG_FILE;
+            break;
+        }
+
+        cur.text = view + skip;
+        cur.lines_cnt = 0;
+        size_t consumed = 0;
+        ret = index_text(&cur, cur.text, len - skip, is_last, lines_done, &consumed);
+        if (ret == 0) {
+            ret = link_lines(&cur);
+        }
+        if (ret == 0) {
+            ret = process(&cur, ctx);
+        }
+
+        unmap_file_region(view, len);
+        free(cur.tail);
+        cur.tail = NULL;
+
+        lines_done += cur.lines_cnt;
+        line_start += consumed;
+    }
+
+    free(cur.keys);
+    free(cur.lines);
+    free(cur.line_pool);
+    return ret;
+}
+
+//=============================================================================
+// Sort keys
+
+/// Packs countable letters of line into key (at most line->len bytes) and fills key_prefix, key_suffix. Returns the end of key
+static inline unsigned char *build_line_key(Line_t *line, unsigned char *key) {
+    line->key = key;
+    for (const unsigned char *c = line->string; c < line->string + line->len; ++c) {
+        if (is_countable(*c)) {
+            *key++ = *c;
+        }
+    }
+    line->key_len = (size_t) (key - line->key);
+
+    line->key_prefix = 0;
+    line->key_suffix = 0;
+    for (size_t j = 0; j < sizeof(line->key_prefix); ++j) {
+        line->key_prefix = line->key_prefix << 8 | (j < line->key_len ? line->key[j] : 0);
+        line->key_suffix = line->key_suffix << 8 | (j < line->key_len ? line->key[line->key_len - 1 - j] : 0);
+    }
+    return key;
+}
+
+int build_sort_keys(File_t *file) {
+    assert(file);
+
+    size_t size = 0;
+    for (size_t i = 0; i < file->lines_cnt; ++i) {
+        size += file->lines[i]->len;
+    }
+
+    if (size > file->keys_size || !file->keys) {
+        unsigned char *keys = (unsigned char*) realloc(file->keys, size + 1);
+        if (!keys) {
+            return ERROR_MALLOC_FAIL;
+        }
+        file->keys = keys;
+        file->keys_size = size;
+    }
+
+    unsigned char *key = file->keys;
+    for (size_t i = 0; i < file->lines_cnt; ++i) {
+        key = build_line_key(file->lines[i], key);
+    }
+
+    return 0;
+}
+
+int compare_lines_keys(const void *elem1, const void *elem2) {
+    const Line_t *first  = *(Line_t* const*) elem1;
+    const Line_t *second = *(Line_t* const*) elem2;
+
+    if (first->key_prefix != second->key_prefix) {
+        return first->key_prefix < second->key_prefix ? -1 : 1;
+    }
+
+    // letters are never '\0', so equal prefixes of keys not longer than 8 mean equal keys
+    const size_t len = first->key_len < second->key_len ? first->key_len : second->key_len;
+    if (len > sizeof(first->key_prefix)) {
+        const int ret = memcmp(first->key + sizeof(first->key_prefix), second->key + sizeof(first->key_prefix),
+                               len - sizeof(first->key_prefix));
+        if (ret) {
+            return ret;
+        }
+    }
+    if (first->key_len != second->key_len) {
+        return first->key_len < second->key_len ? -1 : 1;
+    }
+    return (first->index > second->index) - (first->index < second->index);
+}
+
+int compare_lines_keys_suffix(const void *elem1, const void *elem2) {
+    const Line_t *first  = *(Line_t* const*) elem1;
+    const Line_t *second = *(Line_t* const*) elem2;
+
+    const unsigned char *first_c  = first->key + first->key_len;
+    const unsigned char *second_c = second->key + second->key_len;
+    while (first_c > first->key && second_c > second->key) {
+        --first_c;
+        --second_c;
+        if (*first_c != *second_c) {
+            return (int) *first_c - (int) *second_c;
+        }
+    }
+
+    if (first->key_len != second->key_len) {
+        return first->key_len < second->key_len ? -1 : 1;
+    }
+    return (first->index > second->index) - (first->index < second->index);
+}
+
+#define LESS_LINES_KEYS(elem1, elem2) (compare_lines_keys(elem1, elem2) < 0)
+KCTF_SORT_DEFINE(sort_lines_by_key, Line_t*, LESS_LINES_KEYS)
+
+#define LESS_LINES_KEYS_SUFFIX(elem1, elem2) (compare_lines_keys_suffix(elem1, elem2) < 0)
+KCTF_SORT_DEFINE(sort_lines_by_key_suffix, Line_t*, LESS_LINES_KEYS_SUFFIX)
+
+#define LESS_LINES_INDEX(elem1, elem2) ((*(elem1))->index < (*(elem2))->index)
+KCTF_SORT_DEFINE(sort_lines_by_index, Line_t*, LESS_LINES_INDEX)
+
+//=============================================================================
+// Parallel sort
+
+#define PARALLEL_SORT_MAX_THREADS 64
+#define PARALLEL_SORT_OVERSAMPLE  32
+#define PARALLEL_SORT_MIN_LINES   (1 << 14) ///< per thread, fewer lines are sorted sequentially
+
+typedef struct ParallelSort_t {
+    Line_t **lines;
+    Line_t **buckets;          ///< lines grouped by bucket
+    unsigned char *bucket_of;  ///< bucket of every line
+    size_t cnt;
+    size_t threads;
+    Line_t *splitters[PARALLEL_SORT_MAX_THREADS - 1];
+    size_t counts [PARALLEL_SORT_MAX_THREADS][PARALLEL_SORT_MAX_THREADS]; ///< [thread][bucket], then write positions
+    size_t bucket_begin[PARALLEL_SORT_MAX_THREADS + 1];
+} ParallelSort;
+
+typedef struct ParallelSortTask_t {
+    ParallelSort *sort;
+    size_t id;
+} ParallelSortTask;
+
+/// Number of splitters less than line
+size_t parallel_sort_bucket(const ParallelSort *sort, Line_t *line) {
+    size_t left = 0;
+    size_t right = sort->threads - 1;
+    while (left < right) {
+        const size_t mid = (left + right) / 2;
+        if (compare_lines_keys(&sort->splitters[mid], &line) < 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+void *parallel_sort_classify(void *arg) {
+    const ParallelSortTask *task = (const ParallelSortTask*) arg;
+    ParallelSort *sort = task->sort;
+
+    const size_t begin = sort->cnt * task->id / sort->threads;
+    const size_t end = sort->cnt * (task->id + 1) / sort->threads;
+    for (size_t i = begin; i < end; ++i) {
+        const size_t bucket = parallel_sort_bucket(sort, sort->lines[i]);
+        sort->bucket_of[i] = (unsigned char) bucket;
+        ++sort->counts[task->id][bucket];
+    }
+    return NULL;
+}
+
+void *parallel_sort_scatter(void *arg) {
+    const ParallelSortTask *task = (const ParallelSortTask*) arg;
+    ParallelSort *sort = task->sort;
+
+    const size_t begin = sort->cnt * task->id / sort->threads;
+    const size_t end = sort->cnt * (task->id + 1) / sort->threads;
+    size_t *positions = sort->counts[task->id];
+    for (size_t i = begin; i < end; ++i) {
+        sort->buckets[positions[sort->bucket_of[i]]++] = sort->lines[i];
+    }
+    return NULL;
+}
+
+void *parallel_sort_bucket_sort(void *arg) {
+    const ParallelSortTask *task = (const ParallelSortTask*) arg;
+    ParallelSort *sort = task->sort;
+
+    const size_t begin = sort->bucket_begin[task->id];
+    const size_t cnt = sort->bucket_begin[task->id + 1] - begin;
+    sort_lines_by_key(sort->buckets + begin, cnt);
+    memcpy(sort->lines + begin, sort->buckets + begin, cnt * sizeof(Line_t*));
+    return NULL;
+}
+
+/// Runs phase for every task, a task whose thread can not be started runs in the calling thread,
+/// so every phase is always complete and lines stay a permutation
+void parallel_sort_run(ParallelSort *sort, void *(*phase)(void *arg)) {
+    pthread_t threads[PARALLEL_SORT_MAX_THREADS] = {};
+    ParallelSortTask tasks[PARALLEL_SORT_MAX_THREADS] = {};
+    char started[PARALLEL_SORT_MAX_THREADS] = {};
+
+    for (size_t i = 0; i < sort->threads; ++i) {
+        tasks[i].sort = sort;
+        tasks[i].id = i;
+        started[i] = !pthread_create(&threads[i], NULL, phase, &tasks[i]);
+        if (!started[i]) {
+            phase(&tasks[i]);
+        }
+    }
+    for (size_t i = 0; i < sort->threads; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+int parallel_sort_lines_by_key(Line_t **lines, const size_t cnt, size_t threads) {
+    assert(lines || !cnt);
+
+    if (threads > PARALLEL_SORT_MAX_THREADS) {
+        threads = PARALLEL_SORT_MAX_THREADS;
+    }
+    if (threads > cnt / PARALLEL_SORT_MIN_LINES) {
+        threads = cnt / PARALLEL_SORT_MIN_LINES;
+    }
+    if (threads <= 1) {
+        sort_lines_by_key(lines, cnt);
+        return 0;
+    }
+
+    ParallelSort *sort = (ParallelSort*) calloc(1, sizeof(ParallelSort));
+    const size_t samples_cnt = threads * PARALLEL_SORT_OVERSAMPLE;
+    Line_t **samples = (Line_t**) calloc(samples_cnt, sizeof(Line_t*));
+    if (sort) {
+        sort->buckets = (Line_t**) calloc(cnt, sizeof(Line_t*));
+        sort->bucket_of = (unsigned char*) calloc(cnt, sizeof(unsigned char));
+    }
+    if (!sort || !samples || !sort->buckets || !sort->bucket_of) {
+        if (sort) {
+            free(sort->buckets);
+            free(sort->bucket_of);
+        }
+        free(sort);
+        free(samples);
+        return ERROR_MALLOC_FAIL;
+    }
+
+    sort->lines = lines;
+    sort->cnt = cnt;
+    sort->threads = threads;
+
+    for (size_t i = 0; i < samples_cnt; ++i) {
+        samples[i] = lines[cnt / samples_cnt * i];
+    }
+    sort_lines_by_key(samples, samples_cnt);
+    for (size_t i = 1; i < threads; ++i) {
+        sort->splitters[i - 1] = samples[i * PARALLEL_SORT_OVERSAMPLE];
+    }
+
+    parallel_sort_run(sort, parallel_sort_classify);
+
+    size_t position = 0;
+    for (size_t bucket = 0; bucket < threads; ++bucket) {
+        sort->bucket_begin[bucket] = position;
+        for (size_t id = 0; id < threads; ++id) {
+            const size_t bucket_cnt = sort->counts[id][bucket];
+            sort->counts[id][bucket] = position;
+            position += bucket_cnt;
+        }
+    }
+    sort->bucket_begin[threads] = position;
+
+    parallel_sort_run(sort, parallel_sort_scatter);
+    parallel_sort_run(sort, parallel_sort_bucket_sort);
+
+    free(samples);
+    free(sort->buckets);
+    free(sort->bucket_of);
+    free(sort);
+    return 0;
+}
+
+//=============================================================================
+// String sort
+
+#define STRING_SORT_INSERTION 16
+
+/// depth-th 8 letters of key from the start or from the end as a big-endian number, zero-padded past its end
+static inline unsigned long long string_sort_chunk(const Line_t *line, const size_t depth, const int suffix_order) {
+    if (depth == 0) {
+        return suffix_order ? line->key_suffix : line->key_prefix;
+    }
+
+    unsigned long long chunk = 0;
+    for (size_t i = depth * 8; i < depth * 8 + 8; ++i) {
+        const unsigned char letter = i >= line->key_len ? 0 :
+                                     suffix_order ? line->key[line->key_len - 1 - i] : line->key[i];
+        chunk = chunk << 8 | letter;
+    }
+    return chunk;
+}
+
+/// Compares keys starting from depth-th chunk, ties by index
+static inline int string_sort_compare(const Line_t *first, const Line_t *second, size_t depth, const int suffix_order) {
+    while (1) {
+        const unsigned long long first_c  = string_sort_chunk(first,  depth, suffix_order);
+        const unsigned long long second_c = string_sort_chunk(second, depth, suffix_order);
+        if (first_c != second_c) {
+            return first_c < second_c ? -1 : 1;
+        }
+        if (!(first_c & 0xFF)) {
+            return (first->index > second->index) - (first->index < second->index);
+        }
+        ++depth;
+    }
+}
+
+// Recurses into the two smaller of the three parts, each at most half of lines, and loops on the largest one,
+// so the stack stays O(log n). budget counts partitions of lines at the same depth, when it runs out
+// (bad pivots again and again) the rest is sorted by comparisons like in introsort
+void string_sort_lines_from(Line_t **lines, size_t cnt, size_t depth, const int suffix_order, int budget) {
+    while (cnt > STRING_SORT_INSERTION) {
+        if (budget-- <= 0) {
+            if (suffix_order) {
+                sort_lines_by_key_suffix(lines, cnt);
+            } else {
+                sort_lines_by_key(lines, cnt);
+            }
+            return;
+        }
+
+        size_t first = 0, mid = 0, last = 0;
+        kctf_sort_pick3(cnt, &first, &mid, &last);
+        const unsigned long long a = string_sort_chunk(lines[first], depth, suffix_order);
+        const unsigned long long b = string_sort_chunk(lines[mid],   depth, suffix_order);
+        const unsigned long long c = string_sort_chunk(lines[last],  depth, suffix_order);
+        const unsigned long long pivot = (a < b) ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        // [0, less) < pivot, [less, i) == pivot, [greater, cnt) > pivot
+        size_t less = 0, i = 0, greater = cnt;
+        while (i < greater) {
+            const unsigned long long chunk = string_sort_chunk(lines[i], depth, suffix_order);
+            if (chunk < pivot) {
+                Line_t *tmp = lines[less];
+                lines[less++] = lines[i];
+                lines[i++] = tmp;
+            } else if (chunk > pivot) {
+                Line_t *tmp = lines[--greater];
+                lines[greater] = lines[i];
+                lines[i] = tmp;
+            } else {
+                ++i;
+            }
+        }
+
+        size_t equal_cnt = greater - less;
+        if (!(pivot & 0xFF)) { // letters are never 0, so equal chunks ending with 0 mean equal keys
+            sort_lines_by_index(lines + less, equal_cnt);
+            equal_cnt = 0;
+        }
+
+        Line_t **parts[3]  = {lines, lines + less, lines + greater};
+        const size_t cnts[3]   = {less, equal_cnt, cnt - greater};
+        const size_t depths[3] = {depth, depth + 1, depth};
+        const int budgets[3]   = {budget, kctf_sort_depth_limit(equal_cnt), budget};
+
+        size_t largest = cnts[0] >= cnts[1] ? 0 : 1;
+        if (cnts[2] > cnts[largest]) {
+            largest = 2;
+        }
+        for (size_t part = 0; part < 3; ++part) {
+            if (part != largest) {
+                string_sort_lines_from(parts[part], cnts[part], depths[part], suffix_order, budgets[part]);
+            }
+        }
+
+        lines  = parts[largest];
+        cnt    = cnts[largest];
+        depth  = depths[largest];
+        budget = budgets[largest];
+    }
+
+    for (size_t i = 1; i < cnt; ++i) {
+        for (size_t j = i; j > 0 && string_sort_compare(lines[j], lines[j - 1], depth, suffix_order) < 0; --j) {
+            Line_t *tmp = lines[j];
+            lines[j] = lines[j - 1];
+            lines[j - 1] = tmp;
+        }
+    }
+}
+
+void string_sort_lines(Line_t **lines, const size_t cnt, const int suffix_order) {
+    assert(lines || !cnt);
+
+    string_sort_lines_from(lines, cnt, 0, suffix_order, kctf_sort_depth_limit(cnt));
+}
+
+//=============================================================================
+// External sort
+
+#define EXTERNAL_SORT_MAX_WAYS     64
+#define EXTERNAL_SORT_MIN_BUDGET   (1 << 20)
+#define EXTERNAL_SORT_WINDOW_SHARE 8
+#define EXTERNAL_SORT_READ_BUFFER  (1 << 16) ///< at least this much stdio buffer per merged run
+
+typedef struct ExternalSort_t {
+    const char *fout_name;
+    size_t budget;
+    size_t *runs;       ///< numbers of run files of the current pass, in the order of lines
+    size_t runs_cnt;
+    size_t runs_capacity;
+    size_t next_run;    ///< number of the next run file
+} ExternalSort;
+
+/// Current line of a run being merged, key is stored in buffer after the line
+typedef struct ExternalRun_t {
+    FILE *file;
+    char *stdio_buffer;
+    unsigned char *buffer;
+    size_t capacity;
+    Line_t line;
+} ExternalRun;
+
+void external_sort_run_name(const ExternalSort *sort, const size_t run, char *name, const size_t name_size) {
+    snprintf(name, name_size, "%s.%lu.run", sort->fout_name, (unsigned long) run);
+}
+
+FILE *external_sort_open(const char *name, const char *mode, char *stdio_buffer, const size_t buffer_size) {
+    FILE *file = fopen(name, mode);
+    if (file && stdio_buffer) {
+        setvbuf(file, stdio_buffer, _IOFBF, buffer_size);
+    }
+    return file;
+}
+
+/// Writes lines as print_file does, 0 or ERROR_FILE_NOT_FOUND if the file can not be written
+int external_sort_write_line(FILE *file, const Line_t *line) {
+    if (fputs((const char*) line->string, file) == EOF || putc('\n', file) == EOF) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    return 0;
+}
+
+/// map_file_windows callback: sorts a window and spills it into a new run file
+int external_sort_spill(File_t *window, void *ctx) {
+    ExternalSort *sort = (ExternalSort*) ctx;
+
+    if (sort->runs_cnt == sort->runs_capacity) {
+        const size_t capacity = sort->runs_capacity ? sort->runs_capacity * 2 : 64;
+        size_t *runs = (size_t*) realloc(sort->runs, capacity * sizeof(size_t));
+        if (!runs) {
+            return ERROR_MALLOC_FAIL;
+        }
+        sort->runs = runs;
+        sort->runs_capacity = capacity;
+    }
+
+    int ret = build_sort_keys(window);
+    if (ret < 0) {
+        return ret;
+    }
+    sort_lines_by_key(window->lines, window->lines_cnt);
+
+    char name[FILENAME_MAX] = {};
+    const size_t run = sort->next_run++;
+    external_sort_run_name(sort, run, name, sizeof(name));
+
+    FILE *file = external_sort_open(name, "wb", NULL, 0);
+    if (!file) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    sort->runs[sort->runs_cnt++] = run;
+
+    for (size_t i = 0; i < window->lines_cnt && ret == 0; ++i) {
+        ret = external_sort_write_line(file, window->lines[i]);
+    }
+    if (fclose(file) == EOF && ret == 0) {
+        ret = ERROR_FILE_NOT_FOUND;
+    }
+    return ret;
+}
+
+/// Reads the next line of run and builds its key, 1 if there is one, 0 at the end of run, else error code <0
+int external_sort_next_line(ExternalRun *run) {
+    size_t len = 0;
+    while (1) {
+        if (run->capacity < 2 * (len + 2)) {
+            const size_t capacity = run->capacity ? run->capacity * 2 : 256;
+            unsigned char *buffer = (unsigned char*) realloc(run->buffer, capacity);
+            if (!buffer) {
+                return ERROR_MALLOC_FAIL;
+            }
+            run->buffer = buffer;
+            run->capacity = capacity;
+        }
+
+        const size_t room = run->capacity / 2 - len; // second half is for the key
+        if (!fgets((char*) run->buffer + len, (int) (room < INT_MAX ? room : INT_MAX), run->file)) {
+            if (ferror(run->file)) {
+                return ERROR_FILE_NOT_FOUND;
+            }
+            if (!len) {
+                return 0;
+            }
+            break;
+        }
+
+        len += strlen((char*) run->buffer + len);
+        if (len && run->buffer[len - 1] == '\n') {
+            run->buffer[--len] = '\0';
+            break;
+        }
+    }
+
+    run->line.string = run->buffer;
+    run->line.len = len;
+    build_line_key(&run->line, run->buffer + run->capacity / 2);
+    return 1;
+}
+
+static inline int external_sort_less(const ExternalRun *first, const ExternalRun *second) {
+    const Line_t *first_line  = &first->line;
+    const Line_t *second_line = &second->line;
+    return compare_lines_keys(&first_line, &second_line) < 0;
+}
+
+/// Restores heap order of runs going down from pos, top is the run with the least current line
+void external_sort_sift_down(ExternalRun **heap, const size_t cnt, size_t pos) {
+    while (2 * pos + 1 < cnt) {
+        size_t child = 2 * pos + 1;
+        if (child + 1 < cnt && external_sort_less(heap[child + 1], heap[child])) {
+            ++child;
+        }
+        if (!external_sort_less(heap[child], heap[pos])) {
+            break;
+        }
+
+        ExternalRun *tmp = heap[child];
+        heap[child] = heap[pos];
+        heap[pos] = tmp;
+        pos = child;
+    }
+}
+
+/// Merges runs[0, runs_cnt) into out_name. Runs hold text only, Line_t::index of a run is its position:
+/// runs are consecutive pieces of the input, so equal keys keep the input order for any number of lines
+int external_sort_merge(const ExternalSort *sort, const size_t *runs, const size_t runs_cnt,
+                        const char *out_name, const char *out_mode) {
+    ExternalRun *merged = (ExternalRun*) calloc(runs_cnt + 1, sizeof(ExternalRun));
+    ExternalRun **heap = (ExternalRun**) calloc(runs_cnt + 1, sizeof(ExternalRun*));
+    const size_t read_buffer = sort->budget / 2 / (runs_cnt + 1);
+    const size_t write_buffer = sort->budget / 4;
+    char *out_buffer = (char*) calloc(write_buffer, sizeof(char));
+
+    int ret = merged && heap && out_buffer ? 0 : ERROR_MALLOC_FAIL;
+    size_t heap_cnt = 0;
+    for (size_t i = 0; i < runs_cnt && ret == 0; ++i) {
+        ExternalRun *run = &merged[i];
+        run->line.index = i;
+
+        run->stdio_buffer = (char*) calloc(read_buffer, sizeof(char));
+        if (!run->stdio_buffer) {
+            ret = ERROR_MALLOC_FAIL;
+            break;
+        }
+
+        char name[FILENAME_MAX] = {};
+        external_sort_run_name(sort, runs[i], name, sizeof(name));
+        run->file = external_sort_open(name, "rb", run->stdio_buffer, read_buffer);
+        if (!run->file) {
+            ret = ERROR_FILE_NOT_FOUND;
+            break;
+        }
+
+        ret = external_sort_next_line(run);
+        if (ret > 0) {
+            heap[heap_cnt++] = run;
+            ret = 0;
+        }
+    }
+
+    FILE *out = NULL;
+    if (ret == 0) {
+        out = external_sort_open(out_name, out_mode, out_buffer, write_buffer);
+        ret = out ? 0 : ERROR_FILE_NOT_FOUND;
+    }
+
+    for (size_t i = heap_cnt / 2; i-- > 0;) {
+        external_sort_sift_down(heap, heap_cnt, i);
+    }
+
+    while (heap_cnt && ret == 0) {
+        ret = external_sort_write_line(out, &heap[0]->line);
+        const int next = ret == 0 ? external_sort_next_line(heap[0]) : ret;
+        if (next < 0) {
+            ret = next;
+            break;
+        }
+
+        if (!next) {
+            heap[0] = heap[--heap_cnt];
+        }
+        external_sort_sift_down(heap, heap_cnt, 0);
+    }
+
+    if (out && fclose(out) == EOF && ret == 0) {
+        ret = ERROR_FILE_NOT_FOUND;
+    }
+    for (size_t i = 0; merged && i < runs_cnt; ++i) {
+        if (merged[i].file) {
+            fclose(merged[i].file);
+        }
+        free(merged[i].stdio_buffer);
+        free(merged[i].buffer);
+    }
+    free(out_buffer);
+    free(heap);
+    free(merged);
+    return ret;
+}
+
+void external_sort_remove_runs(const ExternalSort *sort, const size_t *runs, const size_t runs_cnt) {
+    for (size_t i = 0; i < runs_cnt; ++i) {
+        char name[FILENAME_MAX] = {};
+        external_sort_run_name(sort, runs[i], name, sizeof(name));
+        remove(name);
+    }
+}
+
+int external_sort_file(const char *fin_name, const char *fout_name, const size_t memory_budget) {
+    assert(fin_name);
+    assert(fout_name);
+
+    if (memory_budget < EXTERNAL_SORT_MIN_BUDGET) {
+        return ERROR_BAD_ARGS;
+    }
+
+    ExternalSort sort = {};
+    sort.fout_name = fout_name;
+    sort.budget = memory_budget;
+
+    int ret = map_file_windows(fin_name, memory_budget / EXTERNAL_SORT_WINDOW_SHARE, external_sort_spill, &sort);
+
+    size_t ways = memory_budget / 2 / EXTERNAL_SORT_READ_BUFFER;
+    if (ways > EXTERNAL_SORT_MAX_WAYS) {
+        ways = EXTERNAL_SORT_MAX_WAYS;
+    }
+
+    // every pass merges consecutive groups of runs, so the order of equal lines is kept
+    while (ret == 0 && sort.runs_cnt > ways) {
+        size_t merged_cnt = 0;
+        for (size_t begin = 0; begin < sort.runs_cnt && ret == 0; begin += ways) {
+            const size_t cnt = sort.runs_cnt - begin < ways ? sort.runs_cnt - begin : ways;
+            const size_t run = sort.next_run++;
+
+            char name[FILENAME_MAX] = {};
+            external_sort_run_name(&sort, run, name, sizeof(name));
+            ret = external_sort_merge(&sort, sort.runs + begin, cnt, name, "wb");
+            external_sort_remove_runs(&sort, sort.runs + begin, cnt);
+            if (ret < 0) {
+                remove(name);
+                external_sort_remove_runs(&sort, sort.runs + begin + cnt, sort.runs_cnt - begin - cnt);
+                external_sort_remove_runs(&sort, sort.runs, merged_cnt);
+                sort.runs_cnt = 0;
+                break;
+            }
+            sort.runs[merged_cnt++] = run;
+        }
+        if (ret == 0) {
+            sort.runs_cnt = merged_cnt;
+        }
+    }
+
+    if (ret == 0) {
+        ret = external_sort_merge(&sort, sort.runs, sort.runs_cnt, fout_name, "w");
+    }
+    external_sort_remove_runs(&sort, sort.runs, sort.runs_cnt);
+
+    free(sort.runs);
+    return ret;
+}
+
 void free_memory_file(const File_t *file) {
     assert(file);
 
+    free(file->keys);
+    if (file->line_pool || file->mapping_size) {
+        free(file->lines);
+        free(file->line_pool);
+        free(file->tail);
+        if (file->mapping_size) {
+            unmap_file_region(file->text, file->mapping_size);
+        }
+        return;
+    }
+
     Line_t **lines_ptr = file->lines;
     for (int i = 0; i < file->lines_cnt; ++i) {
         free(*lines_ptr);
@@ -308,7 +1529,7 @@ int read_lines(File_t *file) {
             return ERROR_MALLOC_FAIL;
         }
         line_ptr->string = c;
-        line_ptr->index = lines_cnt;
+        line_ptr->index = (size_t) lines_cnt;
 
         while(*c != '\n') {
             ++line_len;
@@ -351,6 +1572,10 @@ void print_error(int error) {
         printf("[ERR] Can't handle such a big file!\n");
     } else if (error == ERROR_MALLOC_FAIL) {
         printf("[ERR] Can't allocate memory\n");
+    } else if (error == ERROR_BAD_ARGS) {
+        printf("[ERR] Bad arguments\n");
+    } else if (error == ERROR_NO_RHYMES) {
+        printf("[ERR] No rhyming lines to make a stanza of\n");
     } else {
         printf("[ERR](~!~)WERRORHUTGEERRORF(~!~)[ERR]\n");
     }
@@ -377,7 +1602,7 @@ int utest_compare_lines_letters() {
         for (int i = 0; i < file.lines_cnt - 1; ++i) {
             if (file.lines[i]->index > file.lines[i + 1]->index && compare_lines_letters(&file.lines[i], &file.lines[i + 1])) {
                 printf("[ERR] \"%s\" > \"%s\"\n", file.lines[i]->string, file.lines[i + 1]->string);
-                printf("[ ! ] indexes: %d > %d\n", file.lines[i]->index, file.lines[i + 1]->index);
+                printf("[ ! ] indexes: %zu > %zu\n", file.lines[i]->index, file.lines[i + 1]->index);
                 DEBUG(2) {
                     printf("====\n");
                     for (int i = 0; i < file.lines_cnt; ++i) {
@@ -391,4 +1616,122 @@ int utest_compare_lines_letters() {
     return 0;
 }
 
+// BENCHMARKS
+
+/// Times qqh_sort with compare_lines_letters against build_sort_keys + sort_lines_by_key on file's lines
+int bench_sort_keys(File_t *file) {
+    assert(file);
+
+    Line_t **lines = (Line_t**) calloc(file->lines_cnt + 1, sizeof(Line_t*));
+    if (!lines) {
+        return ERROR_MALLOC_FAIL;
+    }
+
+    memcpy(lines, file->lines, file->lines_cnt * sizeof(Line_t*));
+    clock_t begin = clock();
+    qqh_sort(lines, file->lines_cnt, sizeof(Line_t*), compare_lines_letters);
+    const double letters_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+    memcpy(lines, file->lines, file->lines_cnt * sizeof(Line_t*));
+    begin = clock();
+    int ret = build_sort_keys(file);
+    const double keys_build_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+    sort_lines_by_key(lines, file->lines_cnt);
+    const double keys_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+    for (size_t i = 1; i < file->lines_cnt; ++i) {
+        if (compare_lines_letters(&lines[i - 1], &lines[i]) > 0) {
+            printf("[ERR] keys order differs at line %zu\n", i);
+            ret = ERROR_BAD_ARGS;
+            break;
+        }
+    }
+
+    printf("[BNC] lines: %zu, compare_lines_letters: %.3lf s, keys: %.3lf s (building %.3lf s)\n",
+           file->lines_cnt, letters_secs, keys_secs, keys_build_secs);
+
+    free(lines);
+    return ret;
+}
+
+/// Checks that parallel_sort_lines_by_key gives the same order as sort_lines_by_key and times it for 1..max_threads threads
+int bench_parallel_sort(File_t *file, const size_t max_threads) {
+    assert(file);
+
+    int ret = build_sort_keys(file);
+    Line_t **expected = (Line_t**) calloc(file->lines_cnt + 1, sizeof(Line_t*));
+    Line_t **lines    = (Line_t**) calloc(file->lines_cnt + 1, sizeof(Line_t*));
+    if (ret < 0 || !expected || !lines) {
+        free(expected);
+        free(lines);
+        return ERROR_MALLOC_FAIL;
+    }
+
+    memcpy(expected, file->lines, file->lines_cnt * sizeof(Line_t*));
+    sort_lines_by_key(expected, file->lines_cnt);
+
+    for (size_t threads = 1; threads <= max_threads && ret == 0; threads *= 2) {
+        memcpy(lines, file->lines, file->lines_cnt * sizeof(Line_t*));
+
+        struct timespec begin = {}, end = {};
+        timespec_get(&begin, TIME_UTC);
+        ret = parallel_sort_lines_by_key(lines, file->lines_cnt, threads);
+        timespec_get(&end, TIME_UTC);
+
+        const int same = !memcmp(lines, expected, file->lines_cnt * sizeof(Line_t*));
+        printf("[BNC] lines: %zu, threads: %2zu, parallel sort: %.3lf s, %s\n", file->lines_cnt, threads,
+               (double) (end.tv_sec - begin.tv_sec) + (double) (end.tv_nsec - begin.tv_nsec) * 1e-9,
+               same ? "same as sequential" : "DIFFERS from sequential");
+        if (!same) {
+            ret = ERROR_BAD_ARGS;
+        }
+    }
+
+    free(expected);
+    free(lines);
+    return ret;
+}
+
+/// Times string_sort_lines against sort_lines_by_key (forward) and qqh_sort with compare_lines_keys_suffix (rhyme)
+int bench_string_sort(File_t *file) {
+    assert(file);
+
+    int ret = build_sort_keys(file);
+    Line_t **expected = (Line_t**) calloc(file->lines_cnt + 1, sizeof(Line_t*));
+    Line_t **lines    = (Line_t**) calloc(file->lines_cnt + 1, sizeof(Line_t*));
+    if (ret < 0 || !expected || !lines) {
+        free(expected);
+        free(lines);
+        return ERROR_MALLOC_FAIL;
+    }
+
+    for (int suffix_order = 0; suffix_order < 2; ++suffix_order) {
+        memcpy(expected, file->lines, file->lines_cnt * sizeof(Line_t*));
+        clock_t begin = clock();
+        if (suffix_order) {
+            qqh_sort(expected, file->lines_cnt, sizeof(Line_t*), compare_lines_keys_suffix);
+        } else {
+            sort_lines_by_key(expected, file->lines_cnt);
+        }
+        const double comparator_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+        memcpy(lines, file->lines, file->lines_cnt * sizeof(Line_t*));
+        begin = clock();
+        string_sort_lines(lines, file->lines_cnt, suffix_order);
+        const double string_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+        const int same = !memcmp(lines, expected, file->lines_cnt * sizeof(Line_t*));
+        printf("[BNC] lines: %zu, order: %s, comparator sort: %.3lf s, string sort: %.3lf s, %s\n",
+               file->lines_cnt, suffix_order ? "rhyme  " : "forward", comparator_secs, string_secs,
+               same ? "same order" : "DIFFERENT order");
+        if (!same) {
+            ret = ERROR_BAD_ARGS;
+        }
+    }
+
+    free(expected);
+    free(lines);
+    return ret;
+}
+
 #endif // KCTF_GENERAL_H
@@ -25,26 +25,46 @@ Last Edit:
 #include "onegin.h"
 
 //#define TEST
+//#define BENCH // compares sorting by compare_lines_letters, by keys, in parallel and string sort on the input, strofa generation
 
-int main(const int argc, const char **argv) {   //--locale=  --test
+int main(const int argc, const char **argv) {   //--locale=  --test  --threads=N  --radix  --memory=MB
     setlocale(LC_CTYPE,"Russian");
 
     #ifdef TEST
         utest_compare_lines_letters();
+        utest_rhyme_index();
     #else
 
     const char *fin_name  = "onegin.txt";
     const char *fout_name = "oneginized.txt";
-
-    if (argc > 1) {
-        fin_name = argv[1];
+    size_t threads = 1;
+    int radix = 0;
+    size_t memory_mb = 0;
+
+    int names_cnt = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strncmp(argv[i], "--threads=", strlen("--threads="))) {
+            const int threads_arg = atoi(argv[i] + strlen("--threads="));
+            threads = threads_arg > 0 ? (size_t) threads_arg : 1;
+        } else if (!strcmp(argv[i], "--radix")) {
+            radix = 1;
+        } else if (!strncmp(argv[i], "--memory=", strlen("--memory="))) {
+            const int memory_arg = atoi(argv[i] + strlen("--memory="));
+            memory_mb = memory_arg > 0 ? (size_t) memory_arg : 0;
+        } else if (names_cnt++ == 0) {
+            fin_name = argv[i];
+        } else {
+            fout_name = argv[i];
+        }
     }
-    if (argc > 2) {
-        fout_name = argv[2];
+
+    if (memory_mb) {   // external sort, the text is never in memory as a whole, so no strofa
+        print_error(external_sort_file(fin_name, fout_name, memory_mb << 20));
+        return 0;
     }
 
     File_t fin = {};
-    int ret = read_file(&fin, fin_name);
+    int ret = map_file(&fin, fin_name);
 
     if (ret < 0) {
         print_error(ret);
@@ -62,7 +82,29 @@ int main(const int argc, const char **argv) {   //--locale=  --test
         calculate_ending(fin.lines[i], RHYME_DEPTH);
     }
 
-    qqh_sort(fin.lines, fin.lines_cnt, sizeof(Line_t*), compare_lines_letters);
+    #ifdef BENCH
+        bench_sort_keys(&fin);
+        bench_parallel_sort(&fin, 64);
+        bench_string_sort(&fin);
+        bench_rhyme_index(&fin, 10);
+    #endif
+
+    ret = build_sort_keys(&fin);
+    if (ret < 0) {
+        print_error(ret);
+        free_memory_file(&fin);
+        return 0;
+    }
+    if (radix) {
+        string_sort_lines(fin.lines, fin.lines_cnt, 0);
+    } else {
+        ret = parallel_sort_lines_by_key(fin.lines, fin.lines_cnt, threads);
+    }
+    if (ret < 0) {
+        print_error(ret);
+        free_memory_file(&fin);
+        return 0;
+    }
 
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wformat"            // Ignoring unexistance of %z in older versions of compiler
@@ -74,12 +116,21 @@ int main(const int argc, const char **argv) {   //--locale=  --test
 
     print_file(&fin, fout_name, "w");
 
-    unsigned int buffer[STROFA_SIZE] = {};
-    gen_strofa((const Line_t**)fin.lines, fin.lines_cnt, buffer, RHYME_DEPTH);
-    for (int i = 0; i < STROFA_SIZE; ++i) {
-        printf("%s\n", fin.lines[buffer[i]]->string);
+    RhymeIndex rhymes = {};
+    const Line_t *strofa[STROFA_SIZE] = {};
+    ret = rhyme_index_add(&rhymes, (const Line_t**)fin.lines, fin.lines_cnt);
+    if (ret == 0) {
+        ret = gen_strofa_indexed(&rhymes, strofa);
+    }
+    if (ret < 0) {
+        print_error(ret);
+    } else {
+        for (int i = 0; i < STROFA_SIZE; ++i) {
+            printf("%s\n", strofa[i]->string);
+        }
     }
 
+    free_rhyme_index(&rhymes);
     free_memory_file(&fin);
 
     #endif
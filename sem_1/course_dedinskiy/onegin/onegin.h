@@ -9,6 +9,8 @@
 #include <assert.h>
 #include "general.h"
 
+#define GEN_STROFA_MAX_TRIES (1ULL << 28) ///< random picks gen_strofa makes before giving up, ~10 s
+
 /**
     @brief Calculates an ending of a line
 
@@ -49,8 +51,107 @@ char rhyming_lines(const Line_t *first, const Line_t *second, const size_t depth
     @param[in] lines_cnt number of lines in text
     @param[out] buffer array of size_t to store output into
     @param[in] RHYME_DEPTH depth of rhyme to check (look at rhyming_lines for desription)
+    @return 0 or ERROR_NO_RHYMES if no strofa is found in GEN_STROFA_MAX_TRIES random picks
+*/
+int gen_strofa(const Line_t **lines, const size_t lines_cnt, unsigned int *buffer, const size_t rhyme_depth);
+
+/// Lines with the same ending, see RhymeIndex
+typedef struct RhymeBucket_t {
+    unsigned char ending[RHYME_DEPTH + 1];
+    const Line_t **lines;
+    size_t lines_cnt;
+    size_t capacity;
+} RhymeBucket;
+
+/// Buckets whose endings differ in the first letter only, so every two of their lines rhyme
+typedef struct RhymeFamily_t {
+    size_t *buckets;
+    size_t buckets_cnt;
+    size_t capacity;
+} RhymeFamily;
+
+/// Hash index of lines by ending, zero-initialize and fill with rhyme_index_add
+typedef struct RhymeIndex_t {
+    RhymeBucket *buckets;
+    size_t buckets_cnt;
+    RhymeFamily *families;
+    size_t families_cnt;
+    size_t *rhymable;           ///< families of two buckets or more
+    size_t rhymable_cnt;
+    size_t capacity;            ///< of buckets, families and rhymable
+    size_t *bucket_table;       ///< open addressing, ending -> bucket number + 1, 0 if empty
+    size_t *family_table;       ///< ending without its first letter -> family number + 1
+    size_t table_size;          ///< power of 2, twice the capacity
+    unsigned long long random;  ///< xorshift state, seeded from time() if 0
+} RhymeIndex;
+
+/**
+    @brief Adds lines to rhyme index
+
+    Puts every line into the bucket of its ending (calculate_ending must be called before), new buckets
+    join the family of their rhymes. Can be called again with another corpus, nothing is rebuilt.
+    Lines without an ending are skipped. Lines are not copied and must outlive the index
+
+    @param[in] index index to add to
+    @param[in] lines lines to add
+    @param[in] lines_cnt number of lines
+    @return 0 or ERROR_MALLOC_FAIL
+*/
+int rhyme_index_add(RhymeIndex *index, const Line_t **lines, const size_t lines_cnt);
+
+/**
+    @brief Picks two random rhyming lines in O(1)
+
+    Picks a random family, two different buckets of it and a random line of each
+
+    @param[in] index rhyme index
+    @param[out] first,second lines, rhyming_lines(first, second) is true
+    @return 0 or ERROR_NO_RHYMES if index has no rhyming lines
+*/
+int rhyme_index_sample_pair(RhymeIndex *index, const Line_t **first, const Line_t **second);
+
+/**
+    @brief Generates new strofa with rhyme index
+
+    Same rhyme scheme as gen_strofa (AbAbCCddEffEgg), O(1) per line and never retries,
+    but lines are taken from any place of the text, not from the same place of another strofa
+
+    @param[in] index rhyme index
+    @param[out] strofa STROFA_SIZE lines
+    @return 0 or ERROR_NO_RHYMES
+*/
+int gen_strofa_indexed(RhymeIndex *index, const Line_t **strofa);
+
+/**
+    @brief Frees memory of rhyme index
+
+    Lines are not freed
+
+    @param[in] index index to free
+*/
+void free_rhyme_index(RhymeIndex *index);
+
+/**
+    @brief Unit test for rhyme index
+
+    Checks that sampled pairs rhyme and that lines added later are sampled
+
+    @return number of errors
 */
-void gen_strofa(const Line_t **lines, const size_t lines_cnt, unsigned int *buffer, const size_t rhyme_depth);
+int utest_rhyme_index();
+
+/**
+    @brief Benchmark of strofa generation
+
+    Times gen_strofa and building rhyme index + gen_strofa_indexed for strofas_cnt strofas.
+    gen_strofa stops at the first strofa it gives up on, see GEN_STROFA_MAX_TRIES
+    Lines must be in the order of the text and have their endings calculated
+
+    @param[in] file text
+    @param[in] strofas_cnt number of strofas to generate
+    @return 0 or error code
+*/
+int bench_rhyme_index(File_t *file, const size_t strofas_cnt);
 
 //=============================================================================
 //========================== REALISATION ======================================
@@ -58,10 +159,10 @@ void gen_strofa(const Line_t **lines, const size_t lines_cnt, unsigned int *buff
 
 void calculate_ending(Line_t *line, const size_t rhyme_depth) {
     int i = line->len - 1;
-    while(!is_countable(line->string[i]) && i) {
+    while(i > 0 && !is_countable(line->string[i])) {
         --i;
     }
-    if (!i) {
+    if (i + 1 < (int) rhyme_depth) { // too short to rhyme, ending stays empty
         return;
     }
 
@@ -107,14 +208,18 @@ char rhyming_lines(const Line_t *first, const Line_t *second, const size_t depth
     return 1;
 }
 
-void gen_strofa(const Line_t **lines, const size_t lines_cnt, unsigned int *buffer, const size_t rhyme_depth) {
+int gen_strofa(const Line_t **lines, const size_t lines_cnt, unsigned int *buffer, const size_t rhyme_depth) {
     assert(lines);
     assert(buffer);
 
     srand(time(NULL));
+    unsigned long long tries = 0;
     for (int i = 0; i < STROFA_SIZE; ++i) {
         int itter = 0;
         while (1) {
+            if (++tries > GEN_STROFA_MAX_TRIES) { // a stanza takes ~2^25 picks, without rhymes (wrong locale) it never ends
+                return ERROR_NO_RHYMES;
+            }
             ++itter;
             if (itter == 100) {
                 i = 0;
@@ -144,6 +249,330 @@ void gen_strofa(const Line_t **lines, const size_t lines_cnt, unsigned int *buff
             }
         }
     }
+    return 0;
+}
+
+//=============================================================================
+// Rhyme index
+
+static size_t rhyme_index_hash(const unsigned char *key, const size_t len) {
+    unsigned long long hash = 14695981039346656037ULL; // FNV-1a
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ key[i]) * 1099511628211ULL;
+    }
+    return (size_t) (hash ^ hash >> 29);
+}
+
+static const unsigned char *rhyme_index_key(const RhymeIndex *index, const size_t number, const int family) {
+    if (family) {
+        return index->buckets[index->families[number].buckets[0]].ending + 1;
+    }
+    return index->buckets[number].ending;
+}
+
+// Slot of ending in bucket_table or, if family, of ending + 1 in family_table. Empty slot if not found
+static size_t *rhyme_index_slot(const RhymeIndex *index, size_t *table, const unsigned char *ending, const int family) {
+    const unsigned char *key = ending + family;
+    const size_t len = RHYME_DEPTH - (size_t) family;
+
+    size_t pos = rhyme_index_hash(key, len) & (index->table_size - 1);
+    while (table[pos] && memcmp(rhyme_index_key(index, table[pos] - 1, family), key, len)) {
+        pos = (pos + 1) & (index->table_size - 1);
+    }
+    return &table[pos];
+}
+
+static int rhyme_index_reserve(RhymeIndex *index) {
+    if (index->buckets_cnt < index->capacity) {
+        return 0;
+    }
+
+    const size_t capacity = index->capacity ? index->capacity * 2 : 64;
+
+    RhymeBucket *buckets = (RhymeBucket*) realloc(index->buckets, capacity * sizeof(RhymeBucket));
+    if (!buckets) {
+        return ERROR_MALLOC_FAIL;
+    }
+    index->buckets = buckets;
+
+    RhymeFamily *families = (RhymeFamily*) realloc(index->families, capacity * sizeof(RhymeFamily));
+    if (!families) {
+        return ERROR_MALLOC_FAIL;
+    }
+    index->families = families;
+
+    size_t *rhymable = (size_t*) realloc(index->rhymable, capacity * sizeof(size_t));
+    if (!rhymable) {
+        return ERROR_MALLOC_FAIL;
+    }
+    index->rhymable = rhymable;
+
+    size_t *bucket_table = (size_t*) calloc(capacity * 2, sizeof(size_t));
+    size_t *family_table = (size_t*) calloc(capacity * 2, sizeof(size_t));
+    if (!bucket_table || !family_table) {
+        free(bucket_table);
+        free(family_table);
+        return ERROR_MALLOC_FAIL;
+    }
+
+    free(index->bucket_table);
+    free(index->family_table);
+    index->bucket_table = bucket_table;
+    index->family_table = family_table;
+    index->table_size = capacity * 2;
+    index->capacity = capacity;
+
+    for (size_t i = 0; i < index->buckets_cnt; ++i) {
+        *rhyme_index_slot(index, bucket_table, index->buckets[i].ending, 0) = i + 1;
+    }
+    for (size_t i = 0; i < index->families_cnt; ++i) {
+        *rhyme_index_slot(index, family_table, rhyme_index_key(index, i, 1) - 1, 1) = i + 1;
+    }
+
+    return 0;
+}
+
+static int rhyme_index_push(void **arr, size_t *cnt, size_t *capacity, const void *elem, const size_t elem_size) {
+    if (*cnt == *capacity) {
+        const size_t new_capacity = *capacity ? *capacity * 2 : 4;
+        void *new_arr = realloc(*arr, new_capacity * elem_size);
+        if (!new_arr) {
+            return ERROR_MALLOC_FAIL;
+        }
+        *arr = new_arr;
+        *capacity = new_capacity;
+    }
+
+    memcpy((char*) *arr + *cnt * elem_size, elem, elem_size);
+    ++*cnt;
+    return 0;
+}
+
+static int rhyme_index_new_bucket(RhymeIndex *index, size_t *bucket_slot, const unsigned char *ending) {
+    const size_t number = index->buckets_cnt;
+    RhymeBucket *bucket = &index->buckets[number];
+    memset(bucket, 0, sizeof(RhymeBucket));
+    memcpy(bucket->ending, ending, RHYME_DEPTH);
+
+    size_t *family_slot = rhyme_index_slot(index, index->family_table, ending, 1);
+    if (!*family_slot) {
+        RhymeFamily *family = &index->families[index->families_cnt];
+        memset(family, 0, sizeof(RhymeFamily));
+        if (rhyme_index_push((void**) &family->buckets, &family->buckets_cnt, &family->capacity, &number, sizeof(size_t))) {
+            return ERROR_MALLOC_FAIL;
+        }
+        *family_slot = ++index->families_cnt;
+    } else {
+        RhymeFamily *family = &index->families[*family_slot - 1];
+        if (rhyme_index_push((void**) &family->buckets, &family->buckets_cnt, &family->capacity, &number, sizeof(size_t))) {
+            return ERROR_MALLOC_FAIL;
+        }
+        if (family->buckets_cnt == 2) {
+            index->rhymable[index->rhymable_cnt++] = *family_slot - 1;
+        }
+    }
+
+    *bucket_slot = ++index->buckets_cnt;
+    return 0;
+}
+
+int rhyme_index_add(RhymeIndex *index, const Line_t **lines, const size_t lines_cnt) {
+    assert(index);
+    assert(lines);
+
+    for (size_t i = 0; i < lines_cnt; ++i) {
+        const Line_t *line = lines[i];
+        if (!line->ending[0]) {
+            continue;
+        }
+
+        int ret = rhyme_index_reserve(index);
+        if (ret < 0) {
+            return ret;
+        }
+
+        size_t *slot = rhyme_index_slot(index, index->bucket_table, line->ending, 0);
+        if (!*slot) {
+            ret = rhyme_index_new_bucket(index, slot, line->ending);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        RhymeBucket *bucket = &index->buckets[*slot - 1];
+        if (rhyme_index_push((void**) &bucket->lines, &bucket->lines_cnt, &bucket->capacity, &line, sizeof(Line_t*))) {
+            return ERROR_MALLOC_FAIL;
+        }
+    }
+
+    return 0;
+}
+
+static size_t rhyme_index_random(RhymeIndex *index, const size_t range) {
+    if (!index->random) {
+        index->random = (unsigned long long) time(NULL) * 2654435761ULL | 1;
+    }
+
+    index->random ^= index->random >> 12; // xorshift64*
+    index->random ^= index->random << 25;
+    index->random ^= index->random >> 27;
+    return (size_t) ((index->random * 2685821657736338717ULL) >> 32) % range;
+}
+
+int rhyme_index_sample_pair(RhymeIndex *index, const Line_t **first, const Line_t **second) {
+    assert(index);
+    assert(first);
+    assert(second);
+
+    if (!index->rhymable_cnt) {
+        return ERROR_NO_RHYMES;
+    }
+
+    const RhymeFamily *family = &index->families[index->rhymable[rhyme_index_random(index, index->rhymable_cnt)]];
+    const size_t i = rhyme_index_random(index, family->buckets_cnt);
+    size_t j = rhyme_index_random(index, family->buckets_cnt - 1);
+    if (j >= i) {
+        ++j;
+    }
+
+    const RhymeBucket *bucket1 = &index->buckets[family->buckets[i]];
+    const RhymeBucket *bucket2 = &index->buckets[family->buckets[j]];
+    *first  = bucket1->lines[rhyme_index_random(index, bucket1->lines_cnt)];
+    *second = bucket2->lines[rhyme_index_random(index, bucket2->lines_cnt)];
+    return 0;
+}
+
+int gen_strofa_indexed(RhymeIndex *index, const Line_t **strofa) {
+    assert(index);
+    assert(strofa);
+
+    static const unsigned char pairs[STROFA_SIZE / 2][2] = {{0, 2}, {1, 3}, {4, 5}, {6, 7}, {8, 11}, {9, 10}, {12, 13}};
+    for (size_t i = 0; i < STROFA_SIZE / 2; ++i) {
+        const int ret = rhyme_index_sample_pair(index, &strofa[pairs[i][0]], &strofa[pairs[i][1]]);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+void free_rhyme_index(RhymeIndex *index) {
+    assert(index);
+
+    for (size_t i = 0; i < index->buckets_cnt; ++i) {
+        free(index->buckets[i].lines);
+    }
+    for (size_t i = 0; i < index->families_cnt; ++i) {
+        free(index->families[i].buckets);
+    }
+    free(index->buckets);
+    free(index->families);
+    free(index->rhymable);
+    free(index->bucket_table);
+    free(index->family_table);
+    memset(index, 0, sizeof(RhymeIndex));
+}
+
+// UNIT TESTS
+
+int utest_rhyme_index() {
+    static const char *corpus1[] = {"she ran away", "trees sway,", "in the hallway!", "the sea", "cold tea", "kid", ""};
+    static const char *corpus2[] = {"grey light", "at night", "he bought", "she caught.", "a gateway"};
+
+    Line_t lines[sizeof(corpus1) / sizeof(corpus1[0]) + sizeof(corpus2) / sizeof(corpus2[0])] = {};
+    const Line_t *ptrs[sizeof(lines) / sizeof(lines[0])] = {};
+    const size_t cnt1 = sizeof(corpus1) / sizeof(corpus1[0]);
+    const size_t cnt = sizeof(lines) / sizeof(lines[0]);
+    for (size_t i = 0; i < cnt; ++i) {
+        lines[i].string = (unsigned char*) (i < cnt1 ? corpus1[i] : corpus2[i - cnt1]);
+        lines[i].len = strlen((const char*) lines[i].string);
+        lines[i].index = i;
+        calculate_ending(&lines[i], RHYME_DEPTH);
+        ptrs[i] = &lines[i];
+    }
+
+    int errors = 0;
+    RhymeIndex index = {};
+    index.random = 2023;
+
+    const Line_t *first = NULL;
+    const Line_t *second = NULL;
+    if (rhyme_index_sample_pair(&index, &first, &second) != ERROR_NO_RHYMES) {
+        printf("[ERR] empty index gave a pair\n");
+        ++errors;
+    }
+
+    for (size_t part = 0; part < 2; ++part) {
+        if (rhyme_index_add(&index, ptrs + (part ? cnt1 : 0), part ? cnt - cnt1 : cnt1)) {
+            printf("[ERR] rhyme_index_add failed\n");
+            free_rhyme_index(&index);
+            return errors + 1;
+        }
+
+        size_t from_corpus2 = 0;
+        for (size_t itter = 0; itter < 1000; ++itter) {
+            if (rhyme_index_sample_pair(&index, &first, &second)) {
+                printf("[ERR] no pair after corpus %zu\n", part + 1);
+                ++errors;
+                break;
+            }
+            if (!rhyming_lines(first, second, RHYME_DEPTH)) {
+                printf("[ERR] \"%s\" does not rhyme with \"%s\"\n", first->string, second->string);
+                ++errors;
+            }
+            from_corpus2 += first->index >= cnt1;
+        }
+        if ((from_corpus2 > 0) != (part == 1)) {
+            printf("[ERR] corpus 2 lines: %zu after corpus %zu\n", from_corpus2, part + 1);
+            ++errors;
+        }
+    }
+
+    const Line_t *strofa[STROFA_SIZE] = {};
+    if (gen_strofa_indexed(&index, strofa)) {
+        printf("[ERR] gen_strofa_indexed failed\n");
+        ++errors;
+    }
+
+    free_rhyme_index(&index);
+    return errors;
+}
+
+// BENCHMARKS
+
+int bench_rhyme_index(File_t *file, const size_t strofas_cnt) {
+    assert(file);
+
+    unsigned int buffer[STROFA_SIZE] = {};
+    clock_t begin = clock();
+    size_t scanned = 0;
+    int ret = 0;
+    while (scanned < strofas_cnt && ret == 0) {
+        ret = gen_strofa((const Line_t**) file->lines, file->lines_cnt, buffer, RHYME_DEPTH);
+        scanned += ret == 0;
+    }
+    const double scan_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+    if (ret < 0) {
+        printf("[BNC] gen_strofa gave up after %.3lf s, %zu strofas found (no rhymes, is the locale right?)\n",
+               scan_secs, scanned);
+    }
+
+    RhymeIndex index = {};
+    const Line_t *strofa[STROFA_SIZE] = {};
+    begin = clock();
+    ret = rhyme_index_add(&index, (const Line_t**) file->lines, file->lines_cnt);
+    const double build_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+    for (size_t i = 0; i < strofas_cnt && ret == 0; ++i) {
+        ret = gen_strofa_indexed(&index, strofa);
+    }
+    const double index_secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+    printf("[BNC] lines: %zu, strofas: %zu, gen_strofa: %.3lf ms/strofa (%zu found), rhyme index: %.3lf ms/strofa + %.3lf s building (%zu endings)\n",
+           file->lines_cnt, strofas_cnt, scan_secs * 1e3 / (double) scanned, scanned, (index_secs - build_secs) * 1e3 / (double) strofas_cnt,
+           build_secs, index.buckets_cnt);
+
+    free_rhyme_index(&index);
+    return ret;
 }
 
 #endif // ONEGIN_H
@@ -117,8 +117,10 @@
 #include <assert.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -168,6 +170,27 @@ const int KCTF_VERIFY_LOUDNESS = 1;
 const int FATAL_ERROR = 2;
 const int CHECK_ERROR = 1;
 
+// KCTF_RELEASE drops all the printing: expr is still evaluated (it often has side effects),
+// failure still exits/returns, but hot path costs just one predicted branch
+
+#if defined(__GNUC__)
+#define KCTF_LIKELY(expr)   __builtin_expect(!!(expr), 1)
+#define KCTF_UNLIKELY(expr) __builtin_expect(!!(expr), 0)
+#else
+#define KCTF_LIKELY(expr)   (expr)
+#define KCTF_UNLIKELY(expr) (expr)
+#endif
+
+#ifdef KCTF_RELEASE
+#define FULL_VERIFY(expr, err_name, loudness, cur_loudness, droptable, ERROR)       \
+    do {                                                                            \
+        int ret = (expr);                                                           \
+        if (KCTF_UNLIKELY(ERROR || !ret)) {                                         \
+            if (droptable) { exit   (ERROR_CHECK_UPPER_VERIFY); }                   \
+            else           { return (ERROR_CHECK_UPPER_VERIFY); }                   \
+        }                                                                           \
+    } while(0)
+#else
 #define FULL_VERIFY(expr, err_name, loudness, cur_loudness, droptable, ERROR)       \
     do {                                                                            \
         int ret = (expr);                                                           \
@@ -187,6 +210,7 @@ const int CHECK_ERROR = 1;
             else           { return (ERROR_CHECK_UPPER_VERIFY); }                   \
         }                                                                           \
     } while(0)
+#endif // KCTF_RELEASE
 
 #define VERIFY_YESDROP(expr, err_name, loudness, cur_loudness) FULL_VERIFY(expr, err_name, loudness, cur_loudness, 1, 0)
 #define VERIFY_LOUDSET(expr, err_name, loudness) VERIFY_YESDROP(expr, err_name, loudness, KCTF_VERIFY_LOUDNESS)
@@ -211,13 +235,365 @@ const int CHECK_ERROR = 1;
 #define CONCAT(a, c) a ## _ ## c
 #define OVERLOAD(func, type) CONCAT(func, type)
 
+//=============================================================================
+//<KCTF> Profiling ============================================================
+
+// KCTF_PROFILE turns KCTF_PROFILE_SCOPE(name) on: it times the rest of the enclosing block
+// (wall clock, or TSC with KCTF_PROFILE_RDTSC), scopes nest freely. Every thread fills its
+// own table, so recording takes no locks; all tables are merged into one report at exit:
+// calls, total, mean and log-linear histogram percentiles (8 sub-buckets per power of two,
+// so a percentile is off by 1/16 of its value at most, like HdrHistogram with 1 digit).
+// Scopes use __attribute__((cleanup)): C++ built with gcc needs -fno-exceptions or libstdc++.
+
+#ifdef KCTF_PROFILE
+
+#include <pthread.h>
+#include <time.h>
+#if defined(KCTF_PROFILE_RDTSC) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define KCTF_PROFILE_USE_TSC 1
+#endif
+
+#define KCTF_PROFILE_MAX_REGIONS 64
+#define KCTF_PROFILE_SUB_BITS    3
+#define KCTF_PROFILE_BUCKETS     (64 << KCTF_PROFILE_SUB_BITS)
+
+typedef struct KctfProfileRegion_t {
+    uint64_t calls;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[KCTF_PROFILE_BUCKETS];
+} KctfProfileRegion;
+
+typedef struct KctfProfileTable_t {
+    KctfProfileRegion regions[KCTF_PROFILE_MAX_REGIONS];
+    struct KctfProfileTable_t *next_table;
+} KctfProfileTable;
+
+typedef struct KctfProfileScope_t {
+    int      region;
+    uint64_t start;
+} KctfProfileScope;
+
+pthread_mutex_t   kctf_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+const char       *kctf_profile_names[KCTF_PROFILE_MAX_REGIONS];
+int               kctf_profile_regions_cnt = 0;
+KctfProfileTable *kctf_profile_tables = NULL;
+__thread KctfProfileTable *kctf_profile_my_table = NULL;
+
+uint64_t kctf_profile_start_ticks = 0;
+uint64_t kctf_profile_start_ns    = 0;
+
+static inline uint64_t kctf_profile_ns() {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+static inline uint64_t kctf_profile_ticks() {
+#ifdef KCTF_PROFILE_USE_TSC
+    return __rdtsc();
+#else
+    return kctf_profile_ns();
+#endif
+}
+
+static inline int kctf_profile_bucket(const uint64_t value) {
+    if (value < (1 << KCTF_PROFILE_SUB_BITS)) {
+        return (int) value;
+    }
+    const int exp = 63 - __builtin_clzll(value);
+    const int sub = (int) (value >> (exp - KCTF_PROFILE_SUB_BITS)) & ((1 << KCTF_PROFILE_SUB_BITS) - 1);
+    return ((exp - KCTF_PROFILE_SUB_BITS + 1) << KCTF_PROFILE_SUB_BITS) + sub;
+}
+
+/// middle of the values that fall into bucket
+double kctf_profile_bucket_value(const int bucket);
+double kctf_profile_bucket_value(const int bucket) {
+    if (bucket < (1 << KCTF_PROFILE_SUB_BITS)) {
+        return bucket;
+    }
+    const int exp = (bucket >> KCTF_PROFILE_SUB_BITS) + KCTF_PROFILE_SUB_BITS - 1;
+    const int sub = bucket & ((1 << KCTF_PROFILE_SUB_BITS) - 1);
+    const double low   = (double) ((((uint64_t) 1 << KCTF_PROFILE_SUB_BITS) + (uint64_t) sub) << (exp - KCTF_PROFILE_SUB_BITS));
+    const double width = (double) ((uint64_t) 1 << (exp - KCTF_PROFILE_SUB_BITS));
+    return low + width / 2;
+}
+
+double kctf_profile_percentile(const KctfProfileRegion *region, const double fraction);
+double kctf_profile_percentile(const KctfProfileRegion *region, const double fraction) {
+    const uint64_t rank = (uint64_t) ((double) region->calls * fraction);
+    uint64_t seen = 0;
+    for (int i = 0; i < KCTF_PROFILE_BUCKETS; ++i) {
+        seen += region->buckets[i];
+        if (seen > rank) {
+            const double value = kctf_profile_bucket_value(i);
+            return value < (double) region->max ? value : (double) region->max;
+        }
+    }
+    return 0;
+}
+
+void kctf_profile_report();
+void kctf_profile_report() {
+    pthread_mutex_lock(&kctf_profile_lock);
+
+    double ns_per_tick = 1;
+#ifdef KCTF_PROFILE_USE_TSC
+    const uint64_t ticks = kctf_profile_ticks() - kctf_profile_start_ticks;
+    const uint64_t ns    = kctf_profile_ns()    - kctf_profile_start_ns;
+    ns_per_tick = ticks ? (double) ns / (double) ticks : 1;
+#endif
+
+    KctfProfileRegion *merged = (KctfProfileRegion*) calloc(1, sizeof(KctfProfileRegion));
+    for (int region = 0; region < kctf_profile_regions_cnt && merged; ++region) {
+        memset(merged, 0, sizeof(KctfProfileRegion));
+        for (KctfProfileTable *table = kctf_profile_tables; table; table = table->next_table) {
+            const KctfProfileRegion *cur = &table->regions[region];
+            merged->calls += cur->calls;
+            merged->total += cur->total;
+            merged->max    = cur->max > merged->max ? cur->max : merged->max;
+            for (int i = 0; i < KCTF_PROFILE_BUCKETS; ++i) {
+                merged->buckets[i] += cur->buckets[i];
+            }
+        }
+        if (!merged->calls) {
+            continue;
+        }
+
+        printf("[PRF]<%s>: [calls](%llu) [total](%.3lf ms) [mean](%.1lf ns) "
+               "[p50](%.0lf ns) [p90](%.0lf ns) [p99](%.0lf ns) [p99.9](%.0lf ns) [max](%.0lf ns)\n",
+               kctf_profile_names[region], (unsigned long long) merged->calls,
+               (double) merged->total * ns_per_tick / 1e6,
+               (double) merged->total * ns_per_tick / (double) merged->calls,
+               kctf_profile_percentile(merged, 0.5)   * ns_per_tick,
+               kctf_profile_percentile(merged, 0.9)   * ns_per_tick,
+               kctf_profile_percentile(merged, 0.99)  * ns_per_tick,
+               kctf_profile_percentile(merged, 0.999) * ns_per_tick,
+               (double) merged->max * ns_per_tick);
+    }
+    free(merged);
+
+    pthread_mutex_unlock(&kctf_profile_lock);
+}
+
+/// Same id for the same name from any thread, called once per KCTF_PROFILE_SCOPE site
+int kctf_profile_region_id(const char *name);
+int kctf_profile_region_id(const char *name) {
+    pthread_mutex_lock(&kctf_profile_lock);
+
+    if (!kctf_profile_regions_cnt && !kctf_profile_tables) {
+        kctf_profile_start_ticks = kctf_profile_ticks();
+        kctf_profile_start_ns    = kctf_profile_ns();
+        atexit(kctf_profile_report);
+    }
+
+    int id = 0;
+    while (id < kctf_profile_regions_cnt && strcmp(kctf_profile_names[id], name)) {
+        ++id;
+    }
+    if (id == kctf_profile_regions_cnt && id < KCTF_PROFILE_MAX_REGIONS) {
+        kctf_profile_names[kctf_profile_regions_cnt++] = name;
+    }
+
+    pthread_mutex_unlock(&kctf_profile_lock);
+    return id < KCTF_PROFILE_MAX_REGIONS ? id : -1;
+}
+
+KctfProfileTable *kctf_profile_new_table();
+KctfProfileTable *kctf_profile_new_table() {
+    KctfProfileTable *table = (KctfProfileTable*) calloc(1, sizeof(KctfProfileTable));
+    if (!table) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&kctf_profile_lock);
+    table->next_table = kctf_profile_tables;
+    kctf_profile_tables = table;
+    pthread_mutex_unlock(&kctf_profile_lock);
+
+    return table;
+}
+
+static inline void kctf_profile_scope_end(KctfProfileScope *scope) {
+    const uint64_t elapsed = kctf_profile_ticks() - scope->start;
+    if (scope->region < 0) {
+        return;
+    }
+    if (!kctf_profile_my_table && !(kctf_profile_my_table = kctf_profile_new_table())) {
+        return;
+    }
+
+    KctfProfileRegion *region = &kctf_profile_my_table->regions[scope->region];
+    ++region->calls;
+    region->total += elapsed;
+    region->max    = elapsed > region->max ? elapsed : region->max;
+    ++region->buckets[kctf_profile_bucket(elapsed)];
+}
+
+#define KCTF_PROFILE_CONCAT_(a, b) a ## b
+#define KCTF_PROFILE_CONCAT(a, b) KCTF_PROFILE_CONCAT_(a, b)
+
+#define KCTF_PROFILE_SCOPE(name)                                                                        \
+    static int KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__) = -2;                                    \
+    if (__atomic_load_n(&KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__), __ATOMIC_RELAXED) == -2) {   \
+        __atomic_store_n(&KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__),                              \
+                         kctf_profile_region_id(name), __ATOMIC_RELAXED);                               \
+    }                                                                                                   \
+    KctfProfileScope KCTF_PROFILE_CONCAT(kctf_profile_scope_, __LINE__)                                 \
+        __attribute__((cleanup(kctf_profile_scope_end))) =                                              \
+        {__atomic_load_n(&KCTF_PROFILE_CONCAT(kctf_profile_id_, __LINE__), __ATOMIC_RELAXED),          \
+         kctf_profile_ticks()}
+
+#else
+
+#define KCTF_PROFILE_SCOPE(name)
+
+#endif
+
+//=============================================================================
+//<KCTF> Microbench ===========================================================
+
+// KCTF_BENCH(name) { setup; KCTF_BENCH_LOOP { measured code; } teardown; }
+// KCTF_BENCH_RUN(name) grows the iteration count x10 until one sample takes KCTF_BENCH_MIN_SECONDS,
+// then takes KCTF_BENCH_SAMPLES samples and prints ns/op mean, stddev and min.
+// kctf_bench_report_to("file.json" or "file.csv") also appends every result there.
+// Feed results to KCTF_DO_NOT_OPTIMIZE, or the compiler may drop the code measured.
+
+#include <time.h>
+
+#define KCTF_BENCH_SAMPLES     10
+#define KCTF_BENCH_MIN_SECONDS 0.02
+#define KCTF_BENCH_MAX_ITERS   ((size_t) 1 << 32)
+
+#define KCTF_DO_NOT_OPTIMIZE(value) __asm__ volatile("" : : "r,m"(value) : "memory")
+#define KCTF_CLOBBER_MEMORY()       __asm__ volatile("" : : : "memory")
+
+typedef struct KctfBenchState_t {
+    size_t iters;
+    size_t done;
+    double start;
+    double elapsed;
+} KctfBenchState;
+
+FILE *kctf_bench_report_file = NULL;
+int   kctf_bench_report_json = 0;
+int   kctf_bench_report_cnt  = 0;
+
+// wall clock, seconds
+double kctf_wall_seconds();
+double kctf_wall_seconds() {
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+static inline int kctf_bench_keep_running(KctfBenchState *state) {
+    if (state->done == 0) {
+        state->start = kctf_wall_seconds();
+    }
+    if (state->done++ < state->iters) {
+        return 1;
+    }
+    state->elapsed = kctf_wall_seconds() - state->start;
+    return 0;
+}
+
+#define KCTF_BENCH_LOOP while (kctf_bench_keep_running(kctf_bench_state))
+
+#define KCTF_BENCH(bench_name) static void KCTF_BENCH_ ## bench_name(KctfBenchState *kctf_bench_state)
+
+// Newton's method, so that general.h users need no -lm
+static inline double kctf_bench_sqrt(const double x) {
+    if (x <= 0) {
+        return 0;
+    }
+
+    double root = x > 1 ? x : 1;
+    for (int i = 0; i < 64; ++i) {
+        root = (root + x / root) / 2;
+    }
+    return root;
+}
+
+int kctf_bench_report_to(const char *file_name);
+int kctf_bench_report_to(const char *file_name) {
+    const size_t len = strlen(file_name);
+    kctf_bench_report_json = len >= 5 && !strcmp(file_name + len - 5, ".json");
+    kctf_bench_report_file = fopen(file_name, "w");
+    if (!kctf_bench_report_file) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    kctf_bench_report_cnt = 0;
+    fprintf(kctf_bench_report_file, kctf_bench_report_json ? "[\n" : "name,ns_per_op,stddev_ns,min_ns,iterations,samples\n");
+    return 0;
+}
+
+int kctf_bench_report_close();
+int kctf_bench_report_close() {
+    if (!kctf_bench_report_file) {
+        return 0;
+    }
+    if (kctf_bench_report_json) {
+        fprintf(kctf_bench_report_file, "\n]\n");
+    }
+    fclose(kctf_bench_report_file);
+    kctf_bench_report_file = NULL;
+    return 0;
+}
+
+double kctf_bench_sample(void (*bench)(KctfBenchState*), const size_t iters);
+double kctf_bench_sample(void (*bench)(KctfBenchState*), const size_t iters) {
+    KctfBenchState state = {iters, 0, 0, 0};
+    bench(&state);
+    return state.elapsed;
+}
+
+int kctf_bench_run(const char *name, void (*bench)(KctfBenchState*));
+int kctf_bench_run(const char *name, void (*bench)(KctfBenchState*)) {
+    size_t iters = 1;
+    while (iters < KCTF_BENCH_MAX_ITERS && kctf_bench_sample(bench, iters) < KCTF_BENCH_MIN_SECONDS) {
+        iters *= 10;
+    }
+
+    double sum = 0, sum_sq = 0, min = 0;
+    for (int i = 0; i < KCTF_BENCH_SAMPLES; ++i) {
+        const double ns = kctf_bench_sample(bench, iters) * 1e9 / (double) iters;
+        sum    += ns;
+        sum_sq += ns * ns;
+        min     = (i == 0 || ns < min) ? ns : min;
+    }
+    const double mean     = sum / KCTF_BENCH_SAMPLES;
+    const double variance = sum_sq / KCTF_BENCH_SAMPLES - mean * mean;
+    const double stddev   = kctf_bench_sqrt(variance);
+
+    printf("[BNC]<%s>: [ns/op](%.2lf) [stddev](%.2lf) [min](%.2lf) [iters](%zu x %d)\n",
+           name, mean, stddev, min, iters, KCTF_BENCH_SAMPLES);
+
+    if (kctf_bench_report_file) {
+        if (kctf_bench_report_json) {
+            fprintf(kctf_bench_report_file,
+                    "%s  {\"name\": \"%s\", \"ns_per_op\": %.3lf, \"stddev_ns\": %.3lf, \"min_ns\": %.3lf, \"iterations\": %zu, \"samples\": %d}",
+                    kctf_bench_report_cnt ? ",\n" : "", name, mean, stddev, min, iters, KCTF_BENCH_SAMPLES);
+        } else {
+            fprintf(kctf_bench_report_file, "%s,%.3lf,%.3lf,%.3lf,%zu,%d\n", name, mean, stddev, min, iters, KCTF_BENCH_SAMPLES);
+        }
+        ++kctf_bench_report_cnt;
+    }
+
+    return 0;
+}
+
+#define KCTF_BENCH_RUN(bench_name) kctf_bench_run(#bench_name, KCTF_BENCH_ ## bench_name)
+
 //=============================================================================
 //<KCTF> Handmade_hash ========================================================
 
 const long long HASH_MODULE = 1000000007;
 const long long BASE = 257;
 
-#define get_hash(struct) do_hash(struct, sizeof(struct))
+#define get_hash(struct) KCTF_HASH(struct, sizeof(struct))
 long long do_hash(const void *memptr, size_t size_in_bytes);
 
 long long do_hash(const void *memptr, size_t size_in_bytes) {
@@ -230,6 +606,62 @@ long long do_hash(const void *memptr, size_t size_in_bytes) {
     return ret;
 }
 
+// Word-wide hash: 8 independent 32-bit lanes eat 32 bytes per step, lanes do not
+// depend on each other, so the loop is vectorized by gcc -O2/-O3 (SSE4.1/AVX2).
+// Result is reduced into [0, HASH_MODULE) to stay a drop-in for do_hash.
+// Define KCTF_HASH_BYTEWISE to fall back to do_hash everywhere KCTF_HASH is used.
+
+#define KCTF_HASH_LANES 8
+
+const uint32_t KCTF_HASH_PRIME_1 = 0x9E3779B1u;
+const uint32_t KCTF_HASH_PRIME_2 = 0x85EBCA77u;
+const uint32_t KCTF_HASH_PRIME_3 = 0xC2B2AE3Du;
+
+long long do_hash_words(const void *memptr, size_t size_in_bytes);
+
+long long do_hash_words(const void *memptr, size_t size_in_bytes) {
+    assert(memptr);
+    const unsigned char *ptr = (const unsigned char*) memptr;
+
+    uint32_t lanes[KCTF_HASH_LANES];
+    for (int i = 0; i < KCTF_HASH_LANES; ++i) {
+        lanes[i] = KCTF_HASH_PRIME_3 + (uint32_t) i * KCTF_HASH_PRIME_1;
+    }
+
+    const size_t step = KCTF_HASH_LANES * sizeof(uint32_t);
+    size_t i = 0;
+    for (; i + step <= size_in_bytes; i += step) {
+        uint32_t words[KCTF_HASH_LANES];
+        memcpy(words, ptr + i, step);
+        for (int j = 0; j < KCTF_HASH_LANES; ++j) {
+            uint32_t lane = lanes[j] + words[j] * KCTF_HASH_PRIME_2;
+            lane = (lane << 13) | (lane >> 19);
+            lanes[j] = lane * KCTF_HASH_PRIME_1;
+        }
+    }
+
+    uint64_t ret = (uint64_t) size_in_bytes * KCTF_HASH_PRIME_1;
+    for (int j = 0; j < KCTF_HASH_LANES; ++j) {
+        ret = (ret ^ lanes[j]) * 0x100000001B3ull;
+        ret ^= ret >> 29;
+    }
+
+    for (; i < size_in_bytes; ++i) {
+        ret = (ret ^ ptr[i]) * 0x100000001B3ull;
+    }
+
+    ret ^= ret >> 32;
+    ret *= KCTF_HASH_PRIME_2;
+    ret ^= ret >> 29;
+    return (long long) (ret % (uint64_t) HASH_MODULE);
+}
+
+#ifdef KCTF_HASH_BYTEWISE
+#define KCTF_HASH(memptr, size_in_bytes) do_hash(memptr, size_in_bytes)
+#else
+#define KCTF_HASH(memptr, size_in_bytes) do_hash_words(memptr, size_in_bytes)
+#endif
+
 //=============================================================================
 ///<KCTF> Handmade stringview =======================================================
 struct Line {
@@ -255,9 +687,9 @@ struct File {
 typedef struct File File_t;
 
 /**
-    \brief Quadratic sort
+    \brief Introsort
 
-    Sorts array on-place with given comparator
+    Sorts array on-place with given comparator in O(n log n), O(n) if it is already sorted. Not stable
 
     \param[in] arr array which needs to be sorted
     \param[in] elem_cnt count of elements, [0, elem_cnt) will be sorted
@@ -384,21 +816,186 @@ void swap_ptrs(void **first, void **second) {
     *first = tmp;
 }
 
-void qqh_sort(void *input_arr, const size_t elem_cnt, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)) {
-    assert(input_arr);
-    assert(comp);
+// Introsort: quicksort with a median of 3 sampled pivot, heapsort once recursion gets deeper than 2 * log2(n),
+// insertion sort below KCTF_SORT_INSERTION elements. A partition that swapped nothing
+// tries to finish both halves with an insertion sort of at most KCTF_SORT_PARTIAL_MOVES moves,
+// so sorted and almost sorted input takes O(n) comparisons.
+//
+// KCTF_SORT_DEFINE(name, type, less) generates static void name(type *arr, size_t cnt),
+// less(const type *a, const type *b) can be a macro or a static inline function and gets inlined.
+// qqh_sort is the same algorithm on void* with a runtime elem_size.
+
+#define KCTF_SORT_INSERTION     16
+#define KCTF_SORT_PARTIAL_MOVES 8
+
+static inline void kctf_sort_swap_bytes(void *first, void *second, size_t elem_size) {
+    unsigned char *a = (unsigned char*) first;
+    unsigned char *b = (unsigned char*) second;
+    for (; elem_size >= sizeof(size_t); elem_size -= sizeof(size_t), a += sizeof(size_t), b += sizeof(size_t)) {
+        size_t tmp = 0;
+        memcpy(&tmp, a, sizeof(size_t));
+        memcpy(a, b, sizeof(size_t));
+        memcpy(b, &tmp, sizeof(size_t));
+    }
+    for (; elem_size; --elem_size, ++a, ++b) {
+        const unsigned char tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
 
-    char *arr = (char*) input_arr;
+/// Three pivot candidates first <= mid <= last, pseudo-random but fixed for a given cnt:
+/// fixed positions like 0, cnt / 2, cnt - 1 keep hitting equal keys on periodic input (a text repeated many times)
+static inline void kctf_sort_pick3(const size_t cnt, size_t *first, size_t *mid, size_t *last) {
+    unsigned long long rnd = (unsigned long long) cnt * 0x9E3779B97F4A7C15ull | 1;
+    size_t picks[3] = {};
+    for (int i = 0; i < 3; ++i) {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 7;
+        rnd ^= rnd << 17;
+        picks[i] = (size_t) (rnd % cnt);
+    }
 
-    for (size_t i = 0; i < elem_cnt; ++i) {
-        for (size_t j = 0; j < elem_cnt - 1; ++j) {
-            void *first = arr + j * elem_size;
-            void *second = arr + (j + 1) * elem_size;
-            if (comp(first, second) > 0) {
-                swap_ptrs((void**) first, (void**) second);
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 2 - i; ++j) {
+            if (picks[j] > picks[j + 1]) {
+                const size_t tmp = picks[j];
+                picks[j] = picks[j + 1];
+                picks[j + 1] = tmp;
             }
         }
     }
+    *first = picks[0];
+    *mid   = picks[1];
+    *last  = picks[2];
+}
+
+static inline int kctf_sort_depth_limit(size_t cnt) {
+    int depth = 0;
+    for (; cnt > 1; cnt >>= 1) {
+        depth += 2;
+    }
+    return depth;
+}
+
+#define KCTF_SORT_UNPACK(...) __VA_ARGS__
+
+// The algorithm itself, elem_t is the type arr points to, AT(arr, i) is the address of the i-th element,
+// LESS(a, b) and SWAP(a, b) take addresses, params/args are extra parameters passed down the recursion
+#define KCTF_SORT_IMPL(name, elem_t, params, args, AT, LESS, SWAP)                                    \
+static inline void name ## _insertion(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) {        \
+    for (size_t i = 1; i < cnt; ++i) {                                                              \
+        for (size_t j = i; j > 0 && LESS(AT(arr, j), AT(arr, j - 1)); --j) {                        \
+            SWAP(AT(arr, j), AT(arr, j - 1));                                                       \
+        }                                                                                           \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static inline int name ## _partial_insertion(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) { \
+    size_t moves = 0;                                                                               \
+    for (size_t i = 1; i < cnt; ++i) {                                                              \
+        for (size_t j = i; j > 0 && LESS(AT(arr, j), AT(arr, j - 1)); --j) {                        \
+            SWAP(AT(arr, j), AT(arr, j - 1));                                                       \
+            if (++moves > KCTF_SORT_PARTIAL_MOVES) {                                                \
+                return 0;                                                                           \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+    return 1;                                                                                       \
+}                                                                                                   \
+                                                                                                    \
+static inline void name ## _sift(elem_t *arr, size_t root, const size_t cnt KCTF_SORT_UNPACK params) { \
+    for (size_t child = 2 * root + 1; child < cnt; root = child, child = 2 * root + 1) {            \
+        if (child + 1 < cnt && LESS(AT(arr, child), AT(arr, child + 1))) {                          \
+            ++child;                                                                                \
+        }                                                                                           \
+        if (!LESS(AT(arr, root), AT(arr, child))) {                                                 \
+            return;                                                                                 \
+        }                                                                                           \
+        SWAP(AT(arr, root), AT(arr, child));                                                        \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static void name ## _heapsort(elem_t *arr, const size_t cnt KCTF_SORT_UNPACK params) {              \
+    for (size_t i = cnt / 2; i > 0; --i) {                                                          \
+        name ## _sift(arr, i - 1, cnt KCTF_SORT_UNPACK args);                                       \
+    }                                                                                               \
+    for (size_t i = cnt - 1; i > 0; --i) {                                                          \
+        SWAP(AT(arr, 0), AT(arr, i));                                                               \
+        name ## _sift(arr, 0, i KCTF_SORT_UNPACK args);                                             \
+    }                                                                                               \
+}                                                                                                   \
+                                                                                                    \
+static void name ## _intro(elem_t *arr, size_t cnt, int depth KCTF_SORT_UNPACK params) {            \
+    while (cnt > KCTF_SORT_INSERTION) {                                                             \
+        if (depth-- == 0) {                                                                         \
+            name ## _heapsort(arr, cnt KCTF_SORT_UNPACK args);                                      \
+            return;                                                                                 \
+        }                                                                                           \
+                                                                                                    \
+        size_t first = 0, mid = 0, last = 0;                                                        \
+        kctf_sort_pick3(cnt, &first, &mid, &last);                                                  \
+        if (LESS(AT(arr, mid), AT(arr, first))) { SWAP(AT(arr, mid), AT(arr, first)); }             \
+        if (LESS(AT(arr, last), AT(arr, mid)))  { SWAP(AT(arr, last), AT(arr, mid));  }             \
+        if (LESS(AT(arr, mid), AT(arr, first))) { SWAP(AT(arr, mid), AT(arr, first)); }             \
+        if (mid) {                                                                                  \
+            SWAP(AT(arr, 0), AT(arr, mid));                                                         \
+        }                                                                                           \
+                                                                                                    \
+        size_t left = 0, right = cnt;                                                               \
+        int swapped = 0;                                                                            \
+        while (1) {                                                                                 \
+            while (++left < right && LESS(AT(arr, left), AT(arr, 0))) {}                            \
+            while (LESS(AT(arr, 0), AT(arr, --right))) {}                                           \
+            if (left >= right) {                                                                    \
+                break;                                                                              \
+            }                                                                                       \
+            SWAP(AT(arr, left), AT(arr, right));                                                    \
+            swapped = 1;                                                                            \
+        }                                                                                           \
+        SWAP(AT(arr, 0), AT(arr, right));                                                           \
+                                                                                                    \
+        elem_t *upper = AT(arr, right + 1);                                                         \
+        const size_t upper_cnt = cnt - right - 1;                                                   \
+        if (!swapped && name ## _partial_insertion(arr, right KCTF_SORT_UNPACK args)                \
+                     && name ## _partial_insertion(upper, upper_cnt KCTF_SORT_UNPACK args)) {       \
+            return;                                                                                 \
+        }                                                                                           \
+                                                                                                    \
+        if (right < upper_cnt) {                                                                    \
+            name ## _intro(arr, right, depth KCTF_SORT_UNPACK args);                                \
+            arr = upper;                                                                            \
+            cnt = upper_cnt;                                                                        \
+        } else {                                                                                    \
+            name ## _intro(upper, upper_cnt, depth KCTF_SORT_UNPACK args);                          \
+            cnt = right;                                                                            \
+        }                                                                                           \
+    }                                                                                               \
+    name ## _insertion(arr, cnt KCTF_SORT_UNPACK args);                                             \
+}
+
+#define KCTF_SORT_TYPED_AT(arr, i) ((arr) + (i))
+#define KCTF_SORT_TYPED_SWAP(a, b) do {__typeof__(*(a)) kctf_sort_tmp = *(a); *(a) = *(b); *(b) = kctf_sort_tmp;} while (0)
+
+#define KCTF_SORT_DEFINE(name, type, less)                                                          \
+KCTF_SORT_IMPL(name, type, (), (), KCTF_SORT_TYPED_AT, less, KCTF_SORT_TYPED_SWAP)                  \
+                                                                                                    \
+static inline void name(type *arr, const size_t cnt) {                                              \
+    name ## _intro(arr, cnt, kctf_sort_depth_limit(cnt));                                           \
+}
+
+#define KCTF_SORT_BYTES_AT(arr, i) ((arr) + (i) * elem_size)
+#define KCTF_SORT_BYTES_LESS(a, b) (comp(a, b) < 0)
+#define KCTF_SORT_BYTES_SWAP(a, b) kctf_sort_swap_bytes(a, b, elem_size)
+
+KCTF_SORT_IMPL(kctf_sort_bytes, char, (, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)), (, elem_size, comp),
+               KCTF_SORT_BYTES_AT, KCTF_SORT_BYTES_LESS, KCTF_SORT_BYTES_SWAP)
+
+void qqh_sort(void *input_arr, const size_t elem_cnt, const size_t elem_size, int (*comp)(const void *elem1, const void *elem2)) {
+    assert(input_arr);
+    assert(comp);
+
+    kctf_sort_bytes_intro((char*) input_arr, elem_cnt, kctf_sort_depth_limit(elem_cnt), elem_size, comp);
 }
 
 void get_next_letter(const unsigned char **c) {
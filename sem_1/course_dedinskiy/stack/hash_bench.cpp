@@ -0,0 +1,45 @@
+#define __USE_MINGW_ANSI_STDIO 1
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "general.h"
+
+// Hash throughput for buffers from 64 B to 64 MB, see "make bench_hash"
+
+const size_t HASH_BENCH_MIN_SIZE    = 64;
+const size_t HASH_BENCH_MAX_SIZE    = 64 << 20;
+const size_t HASH_BENCH_TOTAL_BYTES = 256 << 20; ///< Bytes hashed per size, small buffers are hashed many times
+
+double hash_bench_gbps(long long (*hash)(const void*, size_t), const unsigned char *buffer, const size_t size, long long *sink);
+double hash_bench_gbps(long long (*hash)(const void*, size_t), const unsigned char *buffer, const size_t size, long long *sink) {
+    const size_t itterations = HASH_BENCH_TOTAL_BYTES / size;
+
+    const clock_t begin = clock();
+    for (size_t i = 0; i < itterations; ++i) {
+        *sink += hash(buffer, size - (i & 1)); // size wobble keeps calls from being hoisted
+    }
+    const double secs = (double) (clock() - begin) / CLOCKS_PER_SEC;
+
+    return (double) (itterations * size) / secs / 1e9;
+}
+
+int main() {
+    unsigned char *buffer = (unsigned char*) calloc(HASH_BENCH_MAX_SIZE, sizeof(unsigned char));
+    VERIFY(buffer != NULL);
+    for (size_t i = 0; i < HASH_BENCH_MAX_SIZE; ++i) {
+        buffer[i] = (unsigned char) rand();
+    }
+
+    long long sink = 0;
+    for (size_t size = HASH_BENCH_MIN_SIZE; size <= HASH_BENCH_MAX_SIZE; size *= 4) {
+        const double bytewise = hash_bench_gbps(do_hash,       buffer, size, &sink);
+        const double words    = hash_bench_gbps(do_hash_words, buffer, size, &sink);
+        printf("[BNC]<hash>: [size](%10zu B) [do_hash](%7.3lf GB/s) [do_hash_words](%7.3lf GB/s) [x](%6.1lf)\n",
+               size, bytewise, words, words / bytewise);
+    }
+    printf("[   ]<hash>: [sink](%lld)\n", sink);
+
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,225 @@
+/**
+    \file
+    \brief Lock-free (Treiber) variant of the stack, included by stack.h if STACK_LOCK_FREE is defined
+
+    Nodes are reclaimed with hazard pointers: every thread owns one hazard slot,
+    popped nodes go to a thread-local retired list and are freed only when no slot points to them.
+    Each thread that touched LfStack must call lf_hazard_thread_exit() before it ends.
+*/
+
+#include <sched.h>
+
+//[ONCE_INCLUDING_CONSTANTS]===================================================
+
+#ifndef KCTF_LF_STACK_CONSTANTS
+#define KCTF_LF_STACK_CONSTANTS
+
+#ifndef LF_STACK_MAX_THREADS
+#define LF_STACK_MAX_THREADS 64
+#endif
+
+#define LF_STACK_RETIRE_LIMIT (2 * LF_STACK_MAX_THREADS) ///< > number of hazards, so every scan frees something
+
+#define LF_STACK_GENERIC(func) OVERLOAD(LfStack_##func, STACK_VALUE_TYPE)
+#define LF_STACK_GENERIC_TYPE OVERLOAD(LfStack, STACK_VALUE_TYPE)
+#define LF_STACK_NODE_TYPE OVERLOAD(LfStackNode, STACK_VALUE_TYPE)
+
+#define LF_LOAD(ptr)            __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define LF_STORE(ptr, val)      __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST)
+#define LF_CAS(ptr, expected, desired) \
+    __atomic_compare_exchange_n(ptr, expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+
+//[HAZARD_POINTERS]============================================================
+
+void *lf_hazard_ptrs[LF_STACK_MAX_THREADS]; ///< Nodes that are being read right now, one per thread
+char  lf_hazard_used[LF_STACK_MAX_THREADS]; ///< 1 if slot is owned by some thread
+
+__thread int    lf_hazard_slot = -1;
+__thread void  *lf_retired[LF_STACK_RETIRE_LIMIT];
+__thread size_t lf_retired_cnt = 0;
+
+int  lf_hazard_acquire(void);     ///< Returns slot of current thread, claims a free one on first call, -1 if all are taken
+void lf_hazard_scan(void);        ///< Frees retired nodes no hazard points to
+void lf_hazard_retire(void *ptr); ///< Puts ptr into retired list, scans when it is full
+void lf_hazard_thread_exit(void); ///< Frees all retired nodes of current thread and gives its slot back
+
+int lf_hazard_acquire(void) {
+    if (lf_hazard_slot >= 0) {
+        return lf_hazard_slot;
+    }
+
+    for (int i = 0; i < LF_STACK_MAX_THREADS; ++i) {
+        char expected = 0;
+        if (LF_CAS(&lf_hazard_used[i], &expected, (char) 1)) {
+            lf_hazard_slot = i;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void lf_hazard_scan(void) {
+    void *hazards[LF_STACK_MAX_THREADS];
+    for (int i = 0; i < LF_STACK_MAX_THREADS; ++i) {
+        hazards[i] = LF_LOAD(&lf_hazard_ptrs[i]);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < lf_retired_cnt; ++i) {
+        int is_hazard = 0;
+        for (int j = 0; j < LF_STACK_MAX_THREADS && !is_hazard; ++j) {
+            is_hazard = hazards[j] == lf_retired[i];
+        }
+
+        if (is_hazard) {
+            lf_retired[kept++] = lf_retired[i];
+        } else {
+            free(lf_retired[i]);
+        }
+    }
+    lf_retired_cnt = kept;
+}
+
+void lf_hazard_retire(void *ptr) {
+    lf_retired[lf_retired_cnt++] = ptr;
+    if (lf_retired_cnt == LF_STACK_RETIRE_LIMIT) {
+        lf_hazard_scan();
+    }
+}
+
+void lf_hazard_thread_exit(void) {
+    // hazards of other threads are held only for a few instructions, so this ends quickly
+    while (lf_retired_cnt) {
+        lf_hazard_scan();
+        if (lf_retired_cnt) {
+            sched_yield();
+        }
+    }
+
+    if (lf_hazard_slot >= 0) {
+        LF_STORE(&lf_hazard_ptrs[lf_hazard_slot], (void*) NULL);
+        LF_STORE(&lf_hazard_used[lf_hazard_slot], (char) 0);
+        lf_hazard_slot = -1;
+    }
+}
+
+#endif // KCTF_LF_STACK_CONSTANTS
+
+//=============================================================================
+//<KCTF>[LF_STACK_H]===========================================================
+
+struct LF_STACK_GENERIC(node_t) {
+    STACK_VALUE_TYPE val;
+    struct LF_STACK_GENERIC(node_t) *next;
+};
+
+struct LF_STACK_GENERIC(t) {
+    struct LF_STACK_GENERIC(node_t) *head;
+    size_t size; ///< Exact when no operation is in progress
+};
+
+typedef struct LF_STACK_GENERIC(node_t) LF_STACK_NODE_TYPE;
+typedef struct LF_STACK_GENERIC(t)      LF_STACK_GENERIC_TYPE;
+
+int    LF_STACK_GENERIC(construct)(LF_STACK_GENERIC_TYPE *cake); ///< Not thread-safe, call before sharing the stack
+int    LF_STACK_GENERIC(destruct) (LF_STACK_GENERIC_TYPE *cake); ///< Not thread-safe, call after all threads are done
+
+int    LF_STACK_GENERIC(push)(LF_STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val); ///< Thread-safe push
+int    LF_STACK_GENERIC(pop) (LF_STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest);     ///< Thread-safe pop, ERR_UNDERFLOW if stack is empty. dest may be NULL
+
+size_t LF_STACK_GENERIC(size)    (const LF_STACK_GENERIC_TYPE *cake); ///< Snapshot of current size
+size_t LF_STACK_GENERIC(is_empty)(const LF_STACK_GENERIC_TYPE *cake); ///< Snapshot, 1 if stack is empty
+
+//=============================================================================
+//<KCTF>[LF_STACK_C]===========================================================
+
+int LF_STACK_GENERIC(construct)(LF_STACK_GENERIC_TYPE *cake) {
+    RETURNING_VERIFY(cake != NULL);
+
+    cake->head = NULL;
+    cake->size = 0;
+
+    return OK;
+}
+
+int LF_STACK_GENERIC(destruct)(LF_STACK_GENERIC_TYPE *cake) {
+    RETURNING_VERIFY(cake != NULL);
+
+    LF_STACK_NODE_TYPE *node = cake->head;
+    while (node) {
+        LF_STACK_NODE_TYPE *next = node->next;
+        free(node);
+        node = next;
+    }
+
+    cake->head = NULL;
+    cake->size = SIZE_T_P;
+
+    return OK;
+}
+
+int LF_STACK_GENERIC(push)(LF_STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val) {
+    RETURNING_VERIFY(cake != NULL);
+
+    LF_STACK_NODE_TYPE *node = (LF_STACK_NODE_TYPE*) calloc(1, sizeof(LF_STACK_NODE_TYPE));
+    RETURNING_VERIFY(node != NULL);
+    node->val = val;
+
+    LF_STACK_NODE_TYPE *head = LF_LOAD(&cake->head);
+    do {
+        node->next = head;
+    } while (!LF_CAS(&cake->head, &head, node));
+
+    __atomic_add_fetch(&cake->size, 1, __ATOMIC_RELAXED);
+    return OK;
+}
+
+int LF_STACK_GENERIC(pop)(LF_STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest) {
+    RETURNING_VERIFY(cake != NULL);
+
+    const int slot = lf_hazard_acquire();
+    if (slot < 0) {
+        RETURN_ERROR_VERIFY(ERR_NO_HAZARD_SLOT);
+    }
+
+    LF_STACK_NODE_TYPE *head = NULL;
+    while (1) {
+        head = LF_LOAD(&cake->head);
+        if (!head) {
+            LF_STORE(&lf_hazard_ptrs[slot], (void*) NULL);
+            return ERR_UNDERFLOW;
+        }
+
+        // head can't be freed once it is published and still on top
+        LF_STORE(&lf_hazard_ptrs[slot], (void*) head);
+        if (LF_LOAD(&cake->head) != head) {
+            continue;
+        }
+
+        LF_STACK_NODE_TYPE *next = head->next;
+        if (LF_CAS(&cake->head, &head, next)) {
+            break;
+        }
+    }
+    LF_STORE(&lf_hazard_ptrs[slot], (void*) NULL);
+
+    __atomic_sub_fetch(&cake->size, 1, __ATOMIC_RELAXED);
+    if (dest) {
+        *dest = head->val;
+    }
+    lf_hazard_retire(head);
+
+    return OK;
+}
+
+size_t LF_STACK_GENERIC(size)(const LF_STACK_GENERIC_TYPE *cake) {
+    RETURNING_VERIFY(cake != NULL);
+    return __atomic_load_n(&cake->size, __ATOMIC_RELAXED);
+}
+
+size_t LF_STACK_GENERIC(is_empty)(const LF_STACK_GENERIC_TYPE *cake) {
+    RETURNING_VERIFY(cake != NULL);
+    return LF_LOAD(&cake->head) == NULL;
+}
+//=============================================================================
@@ -0,0 +1,119 @@
+#define __USE_MINGW_ANSI_STDIO 1
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Push/pop throughput of LfStack vs mutex-wrapped Stack from 1 to LF_BENCH_MAX_THREADS, see "make bench_lf"
+
+#ifndef LF_BENCH_MAX_THREADS
+#define LF_BENCH_MAX_THREADS 16
+#endif
+
+#ifndef LF_BENCH_OPS
+#define LF_BENCH_OPS 1000000 ///< push+pop pairs, split between all threads
+#endif
+
+#define STACK_LOCK_FREE
+#define STACK_VALUE_TYPE int
+#define STACK_VALUE_PRINTF_SPEC "%d"
+#include "stack.h"
+#undef STACK_VALUE_TYPE
+#undef STACK_VALUE_PRINTF_SPEC
+
+typedef struct LockedStack_t {
+    Stack_int stack;
+    pthread_mutex_t mutex;
+} LockedStack;
+
+typedef struct BenchArgs_t {
+    LfStack_int *lf_stack;
+    LockedStack *locked_stack;
+    int ops;
+    long long sum;
+} BenchArgs;
+
+double wall_secs(void);
+double wall_secs(void) {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+void *lf_worker(void *raw_args);
+void *lf_worker(void *raw_args) {
+    BenchArgs *args = (BenchArgs*) raw_args;
+    for (int i = 0; i < args->ops; ++i) {
+        int val = 0;
+        LfStack_push_int(args->lf_stack, i);
+        if (LfStack_pop_int(args->lf_stack, &val) == OK) {
+            args->sum += val;
+        }
+    }
+    lf_hazard_thread_exit();
+    return NULL;
+}
+
+void *locked_worker(void *raw_args);
+void *locked_worker(void *raw_args) {
+    BenchArgs *args = (BenchArgs*) raw_args;
+    for (int i = 0; i < args->ops; ++i) {
+        int val = 0;
+        pthread_mutex_lock(&args->locked_stack->mutex);
+        Stack_push_int(&args->locked_stack->stack, i);
+        pthread_mutex_unlock(&args->locked_stack->mutex);
+
+        pthread_mutex_lock(&args->locked_stack->mutex);
+        if (Stack_top_int(&args->locked_stack->stack, &val) == OK) {
+            Stack_pop_int(&args->locked_stack->stack);
+            args->sum += val;
+        }
+        pthread_mutex_unlock(&args->locked_stack->mutex);
+    }
+    return NULL;
+}
+
+double run_bench(void *(*worker)(void*), LfStack_int *lf_stack, LockedStack *locked_stack, const int threads_cnt);
+double run_bench(void *(*worker)(void*), LfStack_int *lf_stack, LockedStack *locked_stack, const int threads_cnt) {
+    pthread_t threads[LF_BENCH_MAX_THREADS];
+    BenchArgs args[LF_BENCH_MAX_THREADS];
+
+    const double begin = wall_secs();
+    for (int i = 0; i < threads_cnt; ++i) {
+        args[i].lf_stack = lf_stack;
+        args[i].locked_stack = locked_stack;
+        args[i].ops = LF_BENCH_OPS / threads_cnt;
+        args[i].sum = 0;
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+    for (int i = 0; i < threads_cnt; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    const double secs = wall_secs() - begin;
+
+    return (double) (LF_BENCH_OPS / threads_cnt * threads_cnt) * 2 / secs / 1e6;
+}
+
+int main() {
+    LfStack_int lf_stack = {};
+    VERIFY_OK(LfStack_construct_int(&lf_stack));
+
+    LockedStack locked_stack = {};
+    VERIFY_OK(Stack_construct_int(&locked_stack.stack));
+    pthread_mutex_init(&locked_stack.mutex, NULL);
+
+    for (int threads_cnt = 1; threads_cnt <= LF_BENCH_MAX_THREADS; threads_cnt *= 2) {
+        const double lf_mops     = run_bench(lf_worker,     &lf_stack, &locked_stack, threads_cnt);
+        const double locked_mops = run_bench(locked_worker, &lf_stack, &locked_stack, threads_cnt);
+        printf("[BNC]<lf_stack>: [threads](%3d) [lock_free](%8.2lf Mops/s) [mutex](%8.2lf Mops/s)\n",
+               threads_cnt, lf_mops, locked_mops);
+    }
+
+    VERIFY(LfStack_is_empty_int(&lf_stack) == 1);
+    VERIFY(Stack_is_empty_int(&locked_stack.stack) == 1);
+
+    pthread_mutex_destroy(&locked_stack.mutex);
+    VERIFY_OK(Stack_destruct_int(&locked_stack.stack));
+    VERIFY_OK(LfStack_destruct_int(&lf_stack));
+    return 0;
+}
@@ -0,0 +1,236 @@
+/**
+    \file
+    \brief Segmented variant of the stack, included by stack.h if STACK_SEGMENTED is defined
+
+    Storage is a chain of fixed-size blocks, so growth never copies and never moves elements:
+    pointer to an element stays valid until the element is popped. Emptied blocks are kept
+    in a small cache (STACK_SEGMENT_CACHE blocks) instead of being freed right away.
+    SegStack_reserve fills the cache up front, then growth up to the reserved size never calls malloc.
+*/
+
+//[ONCE_INCLUDING_CONSTANTS]===================================================
+
+#ifndef KCTF_SEG_STACK_CONSTANTS
+#define KCTF_SEG_STACK_CONSTANTS
+
+#ifndef STACK_SEGMENT_SIZE
+#define STACK_SEGMENT_SIZE 4096 ///< Elements in one block
+#endif
+
+#ifndef STACK_SEGMENT_CACHE
+#define STACK_SEGMENT_CACHE 2 ///< Empty blocks kept for reuse, 0 frees them at once
+#endif
+
+#define SEG_STACK_GENERIC(func) OVERLOAD(SegStack_##func, STACK_VALUE_TYPE)
+#define SEG_STACK_GENERIC_TYPE OVERLOAD(SegStack, STACK_VALUE_TYPE)
+#define SEG_STACK_BLOCK_TYPE OVERLOAD(SegStackBlock, STACK_VALUE_TYPE)
+
+#ifdef KCTF_RELEASE
+#define SEG_STACK_OK(stack) do {} while(0)
+#else
+#define SEG_STACK_OK(stack) do {RETURNING_VERIFY_OK(SEG_STACK_GENERIC(valid)(stack));} while(0)
+#endif
+
+#endif // KCTF_SEG_STACK_CONSTANTS
+
+//=============================================================================
+//<KCTF>[SEG_STACK_H]==========================================================
+
+struct SEG_STACK_GENERIC(block_t) {
+    struct SEG_STACK_GENERIC(block_t) *prev; ///< Block below, or next cached block while in cache
+    STACK_VALUE_TYPE data[STACK_SEGMENT_SIZE];
+};
+
+struct SEG_STACK_GENERIC(t) {
+    struct SEG_STACK_GENERIC(block_t) *top;
+    size_t top_size; ///< Elements in top block, 0 only if the whole stack is empty
+    size_t size;
+
+    struct SEG_STACK_GENERIC(block_t) *cache;
+    size_t cache_size;
+    size_t cache_limit; ///< STACK_SEGMENT_CACHE, or more after reserve
+};
+
+typedef struct SEG_STACK_GENERIC(block_t) SEG_STACK_BLOCK_TYPE;
+typedef struct SEG_STACK_GENERIC(t)       SEG_STACK_GENERIC_TYPE;
+
+int    SEG_STACK_GENERIC(construct)(SEG_STACK_GENERIC_TYPE *cake); ///< Constructs stack with one empty block
+int    SEG_STACK_GENERIC(destruct) (SEG_STACK_GENERIC_TYPE *cake); ///< Frees all blocks, cached ones too
+int    SEG_STACK_GENERIC(valid)    (const SEG_STACK_GENERIC_TYPE *cake); ///< Checks, if stack is valid, returns 0 if is, err_code otherwise, O(1)
+
+int    SEG_STACK_GENERIC(push)   (SEG_STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val); ///< Pushes val, O(1), never moves other elements
+int    SEG_STACK_GENERIC(pop)    (SEG_STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest); ///< Pops top val into *dest, dest may be NULL
+int    SEG_STACK_GENERIC(top)    (const SEG_STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest); ///< Copies top val into *dest
+STACK_VALUE_TYPE *SEG_STACK_GENERIC(top_ptr)(SEG_STACK_GENERIC_TYPE *cake); ///< Address of top val, valid until it is popped. NULL if stack is empty
+
+int    SEG_STACK_GENERIC(reserve)   (SEG_STACK_GENERIC_TYPE *cake, const size_t capacity); ///< Allocates blocks for capacity elements now and keeps them cached when popped
+int    SEG_STACK_GENERIC(drop_cache)(SEG_STACK_GENERIC_TYPE *cake); ///< Gives cached empty blocks back to allocator, cancels reserve
+size_t SEG_STACK_GENERIC(size)      (const SEG_STACK_GENERIC_TYPE *cake); ///< Returns current number of elements
+
+//=============================================================================
+//<KCTF>[SEG_STACK_C]==========================================================
+
+int SEG_STACK_GENERIC(construct)(SEG_STACK_GENERIC_TYPE *cake) {
+    RETURNING_VERIFY(cake != NULL);
+
+    cake->top = (SEG_STACK_BLOCK_TYPE*) calloc(1, sizeof(SEG_STACK_BLOCK_TYPE));
+    RETURNING_VERIFY(cake->top != NULL);
+
+    cake->top_size   = 0;
+    cake->size       = 0;
+    cake->cache       = NULL;
+    cake->cache_size  = 0;
+    cake->cache_limit = STACK_SEGMENT_CACHE;
+
+    SEG_STACK_OK(cake);
+    return OK;
+}
+
+int SEG_STACK_GENERIC(destruct)(SEG_STACK_GENERIC_TYPE *cake) {
+    SEG_STACK_OK(cake);
+
+    SEG_STACK_GENERIC(drop_cache)(cake);
+    while (cake->top) {
+        SEG_STACK_BLOCK_TYPE *prev = cake->top->prev;
+        free(cake->top);
+        cake->top = prev;
+    }
+
+    cake->top_size = SIZE_T_P;
+    cake->size     = SIZE_T_P;
+
+    return OK;
+}
+
+int SEG_STACK_GENERIC(valid)(const SEG_STACK_GENERIC_TYPE *cake) {
+    if (!cake) {
+        RETURN_ERROR_VERIFY(ERR_STACK_NOT_EXIST);
+    }
+
+    if (!cake->top) {
+        RETURN_ERROR_VERIFY(ERR_BUFFER_NOT_EXIST);
+    }
+
+    if (cake->top_size > STACK_SEGMENT_SIZE || cake->top_size > cake->size
+        || (cake->top_size == 0 && (cake->size != 0 || cake->top->prev != NULL))) {
+        RETURN_ERROR_VERIFY(ERR_OVERFLOW);
+    }
+
+    if (cake->cache_size > cake->cache_limit || cake->cache_limit < STACK_SEGMENT_CACHE) {
+        RETURN_ERROR_VERIFY(ERR_OVERFLOW);
+    }
+
+    return OK;
+}
+
+int SEG_STACK_GENERIC(push)(SEG_STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val) {
+    SEG_STACK_OK(cake);
+
+    if (cake->top_size == STACK_SEGMENT_SIZE) {
+        SEG_STACK_BLOCK_TYPE *block = cake->cache;
+        if (block) {
+            cake->cache = block->prev;
+            --cake->cache_size;
+        } else {
+            block = (SEG_STACK_BLOCK_TYPE*) malloc(sizeof(SEG_STACK_BLOCK_TYPE));
+            RETURNING_VERIFY(block != NULL);
+        }
+
+        block->prev    = cake->top;
+        cake->top      = block;
+        cake->top_size = 0;
+    }
+
+    cake->top->data[cake->top_size++] = val;
+    ++cake->size;
+
+    return OK;
+}
+
+int SEG_STACK_GENERIC(pop)(SEG_STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest) {
+    SEG_STACK_OK(cake);
+    RETURNING_VERIFY(cake->size > 0);
+
+    --cake->top_size;
+    --cake->size;
+    if (dest) {
+        *dest = cake->top->data[cake->top_size];
+    }
+
+    if (cake->top_size == 0 && cake->top->prev) {
+        SEG_STACK_BLOCK_TYPE *block = cake->top;
+        cake->top      = block->prev;
+        cake->top_size = STACK_SEGMENT_SIZE;
+
+        if (cake->cache_size < cake->cache_limit) {
+            block->prev = cake->cache;
+            cake->cache = block;
+            ++cake->cache_size;
+        } else {
+            free(block);
+        }
+    }
+
+    return OK;
+}
+
+int SEG_STACK_GENERIC(top)(const SEG_STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest) {
+    SEG_STACK_OK(cake);
+    RETURNING_VERIFY(dest != NULL);
+    RETURNING_VERIFY(cake->size > 0);
+
+    *dest = cake->top->data[cake->top_size - 1];
+    return OK;
+}
+
+STACK_VALUE_TYPE *SEG_STACK_GENERIC(top_ptr)(SEG_STACK_GENERIC_TYPE *cake) {
+    if (SEG_STACK_GENERIC(valid)(cake) != OK || cake->size == 0) {
+        return NULL;
+    }
+
+    return &cake->top->data[cake->top_size - 1];
+}
+
+int SEG_STACK_GENERIC(reserve)(SEG_STACK_GENERIC_TYPE *cake, const size_t capacity) {
+    SEG_STACK_OK(cake);
+
+    const size_t needed = capacity > STACK_SEGMENT_SIZE ? (capacity + STACK_SEGMENT_SIZE - 1) / STACK_SEGMENT_SIZE : 1;
+    const size_t used   = cake->size ? (cake->size - cake->top_size) / STACK_SEGMENT_SIZE + 1 : 1;
+
+    // the bottom block is never cached, so the cache must hold the rest to survive popping everything
+    if (needed - 1 > cake->cache_limit) {
+        cake->cache_limit = needed - 1;
+    }
+
+    while (used + cake->cache_size < needed) {
+        SEG_STACK_BLOCK_TYPE *block = (SEG_STACK_BLOCK_TYPE*) malloc(sizeof(SEG_STACK_BLOCK_TYPE));
+        RETURNING_VERIFY(block != NULL);
+
+        block->prev = cake->cache;
+        cake->cache = block;
+        ++cake->cache_size;
+    }
+
+    SEG_STACK_OK(cake);
+    return OK;
+}
+
+int SEG_STACK_GENERIC(drop_cache)(SEG_STACK_GENERIC_TYPE *cake) {
+    SEG_STACK_OK(cake);
+
+    while (cake->cache) {
+        SEG_STACK_BLOCK_TYPE *next = cake->cache->prev;
+        free(cake->cache);
+        cake->cache = next;
+    }
+    cake->cache_size  = 0;
+    cake->cache_limit = STACK_SEGMENT_CACHE;
+
+    return OK;
+}
+
+size_t SEG_STACK_GENERIC(size)(const SEG_STACK_GENERIC_TYPE *cake) {
+    SEG_STACK_OK(cake);
+    return cake->size;
+}
+//=============================================================================
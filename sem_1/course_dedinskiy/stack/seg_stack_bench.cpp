@@ -0,0 +1,109 @@
+#define __USE_MINGW_ANSI_STDIO 1
+
+#include <stdlib.h>
+#include <time.h>
+
+// Push latency of realloc-based Stack vs SegStack, see "make bench_seg"
+// On a loaded (or single-core) machine max_push is mostly preemption, it can hit any push.
+// max_grow is the worst push that actually grew the storage: realloc for Stack, new block for SegStack
+
+#ifndef SEG_BENCH_N
+#define SEG_BENCH_N (1 << 27) ///< 512 MB of ints
+#endif
+
+#define STACK_SEGMENTED
+#define STACK_VALUE_TYPE int
+#define STACK_VALUE_PRINTF_SPEC "%d"
+#include "stack.h"
+#undef STACK_VALUE_TYPE
+#undef STACK_VALUE_PRINTF_SPEC
+
+double wall_ns(void);
+double wall_ns(void) {
+    struct timespec ts = {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+const double SEG_BENCH_SPIKE_NS = 1e5; ///< Push slower than 0.1 ms is a spike
+
+struct PushLatency {
+    double total_ns;
+    double max_ns;
+    double max_grow_ns;
+    int spikes;
+    int grows;
+};
+
+void add_push(PushLatency *latency, const double op_ns, const int grew);
+void add_push(PushLatency *latency, const double op_ns, const int grew) {
+    latency->max_ns = op_ns > latency->max_ns ? op_ns : latency->max_ns;
+    latency->spikes += op_ns > SEG_BENCH_SPIKE_NS;
+    if (grew) {
+        latency->max_grow_ns = op_ns > latency->max_grow_ns ? op_ns : latency->max_grow_ns;
+        ++latency->grows;
+    }
+}
+
+void print_latency(const char *name, const PushLatency *latency);
+void print_latency(const char *name, const PushLatency *latency) {
+    printf("[BNC]<seg_stack>: [%-14s] [n](%d) [push](%6.2lf ns/op) [max_push](%8.3lf ms) [spikes](%d) [max_grow](%8.3lf ms) [grows](%d)\n",
+           name, SEG_BENCH_N, latency->total_ns / SEG_BENCH_N, latency->max_ns / 1e6, latency->spikes,
+           latency->max_grow_ns / 1e6, latency->grows);
+}
+
+PushLatency push_seg_stack(SegStack_int *seg_stack);
+PushLatency push_seg_stack(SegStack_int *seg_stack) {
+    PushLatency latency = {};
+    const double begin = wall_ns();
+    for (int i = 0; i < SEG_BENCH_N; ++i) {
+        const SegStackBlock_int *top = seg_stack->top;
+        const double op_begin = wall_ns();
+        SegStack_push_int(seg_stack, i);
+        add_push(&latency, wall_ns() - op_begin, seg_stack->top != top);
+    }
+    latency.total_ns = wall_ns() - begin;
+    return latency;
+}
+
+int main() {
+    Stack_int stack = {};
+    VERIFY_OK(Stack_construct_int(&stack));
+
+    PushLatency latency = {};
+    double begin = wall_ns();
+    for (int i = 0; i < SEG_BENCH_N; ++i) {
+        const size_t capacity = stack.capacity;
+        const double op_begin = wall_ns();
+        Stack_push_int(&stack, i);
+        add_push(&latency, wall_ns() - op_begin, stack.capacity != capacity);
+    }
+    latency.total_ns = wall_ns() - begin;
+    print_latency("stack", &latency);
+    VERIFY_OK(Stack_destruct_int(&stack));
+
+    SegStack_int seg_stack = {};
+    VERIFY_OK(SegStack_construct_int(&seg_stack));
+
+    latency = push_seg_stack(&seg_stack);
+    print_latency("seg_stack", &latency);
+
+    // every block stays cached, so the second growth is malloc-free and touches warm pages
+    VERIFY_OK(SegStack_reserve_int(&seg_stack, SEG_BENCH_N));
+    int val = 0;
+    for (int i = SEG_BENCH_N - 1; i >= 0; --i) {
+        VERIFY_OK(SegStack_pop_int(&seg_stack, &val));
+        VERIFY(val == i);
+    }
+
+    latency = push_seg_stack(&seg_stack);
+    print_latency("seg_stack_warm", &latency);
+
+    for (int i = SEG_BENCH_N - 1; i >= 0; --i) {
+        VERIFY_OK(SegStack_pop_int(&seg_stack, &val));
+        VERIFY(val == i);
+    }
+    VERIFY_OK(SegStack_destruct_int(&seg_stack));
+
+    return 0;
+}
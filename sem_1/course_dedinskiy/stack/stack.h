@@ -4,6 +4,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "general.h"
 
 //[DEFINES]===================================================================
@@ -19,7 +20,11 @@
 //[SECURITY_SETTINGS]==========================================================
 
 #ifndef STACK_SECURITY_LEVEL
+#ifdef KCTF_RELEASE
+#define STACK_SECURITY_LEVEL 0
+#else
 #define STACK_SECURITY_LEVEL 10
+#endif
 #endif // STACK_SECURITY_LEVEL
 
 #if STACK_SECURITY_LEVEL > 0
@@ -30,10 +35,36 @@
 #define SEC_HASH
 #endif
 
+// Incremental hash: push/pop update buffer hash in O(1), only valid() rehashes the live prefix
+#if defined(SEC_HASH) && defined(STACK_HASH_INCREMENTAL)
+#define SEC_HASH_INCREMENTAL
+#endif
+
 #ifndef STACK_DUMP_DEPTH
 #define STACK_DUMP_DEPTH 10
 #endif
 
+//[CAPACITY_POLICY]============================================================
+// Shrink happens when capacity > (size + 1) * STACK_SHRINK_TRIGGER and leaves
+// capacity = (size + 1) * STACK_SHRINK_TARGET. Keep GROW > 1 and TRIGGER > TARGET > 1,
+// the gap between them is the hysteresis that stops push/pop realloc ping-pong.
+
+#ifndef STACK_GROW_COEF
+#define STACK_GROW_COEF 1.5
+#endif
+
+#ifndef STACK_SHRINK_TRIGGER
+#define STACK_SHRINK_TRIGGER 4
+#endif
+
+#ifndef STACK_SHRINK_TARGET
+#define STACK_SHRINK_TARGET 2
+#endif
+
+#ifndef STACK_MIN_CAPACITY
+#define STACK_MIN_CAPACITY 32
+#endif
+
 //=============================================================================
 //[ONCE_INCLUDING_CONSTANTS]===================================================
 
@@ -42,7 +73,15 @@
 
 #define STACK_GENERIC(func) OVERLOAD(Stack_##func, STACK_VALUE_TYPE)
 #define STACK_GENERIC_TYPE OVERLOAD(Stack, STACK_VALUE_TYPE)
-#define STACK_OK(stack) do {RETURNING_VERIFY_OK(STACK_GENERIC(valid)(stack));} while(0)
+
+#define STACK_STRINGIFY_(x) #x
+#define STACK_STRINGIFY(x) STACK_STRINGIFY_(x)
+#define STACK_PROFILE_SCOPE(func) KCTF_PROFILE_SCOPE(STACK_STRINGIFY(STACK_GENERIC(func)))
+#ifdef KCTF_RELEASE
+#define STACK_OK(stack) do {} while(0) // call Stack_valid yourself if you need it
+#else
+#define STACK_OK(stack) do {RETURNING_VERIFY_OK(STACK_GENERIC(valid_fast)(stack));} while(0)
+#endif
 #define STACK_HASH(stack) STACK_GENERIC(hash)(stack)
 
 typedef enum stack_code {
@@ -51,14 +90,42 @@ typedef enum stack_code {
     ERR_BUFFER_NOT_EXIST,
     ERR_OVERFLOW,
     ERR_REALLOC_FAILED,
+    ERR_UNDERFLOW,
+    ERR_NO_HAZARD_SLOT,
 
     OK = 0,
 } stack_code;
 
 const long long STACK_CANARY = 0xDED0C;
+const long long STACK_HASH_INV_BASE = 70038911; ///< BASE^(-1) mod HASH_MODULE, used to retract hash on pop
+
+const double STACK_REALLOC_UP_COEF      = STACK_GROW_COEF;
+const double STACK_REALLOC_DOWN_COEF    = STACK_SHRINK_TRIGGER;
+const double STACK_REALLOC_DOWN_TARGET  = STACK_SHRINK_TARGET;
+const size_t STACK_REALLOC_MIN_CAPACITY = STACK_MIN_CAPACITY;
+
+size_t stack_grown_capacity (size_t capacity, const size_t needed); ///< Capacity after growing by policy until needed elements fit
+size_t stack_shrunk_capacity(const size_t capacity, const size_t size); ///< Capacity after shrinking by policy, same capacity if no shrink is needed
+
+size_t stack_grown_capacity(size_t capacity, const size_t needed) {
+    while (capacity < needed) {
+        const size_t grown = (size_t)((double) capacity * STACK_REALLOC_UP_COEF);
+        capacity = grown > capacity ? grown : capacity + 1;
+    }
+    return capacity;
+}
 
-const double STACK_REALLOC_UP_COEF = 1.5;
-const double STACK_REALLOC_DOWN_COEF = 2;
+size_t stack_shrunk_capacity(const size_t capacity, const size_t size) {
+    if ((double) capacity / (double) (size + 1) <= STACK_REALLOC_DOWN_COEF) {
+        return capacity;
+    }
+
+    size_t target = (size_t)((double) (size + 1) * STACK_REALLOC_DOWN_TARGET);
+    if (target < STACK_REALLOC_MIN_CAPACITY) {
+        target = STACK_REALLOC_MIN_CAPACITY;
+    }
+    return target < capacity ? target : capacity;
+}
 #endif // KCTF_STACK_CONSTANTS
 
 //=============================================================================
@@ -80,6 +147,10 @@ struct STACK_GENERIC(t) {
     STACK_VALUE_TYPE *buffer;
 //=============================================================================
 //[SOME_AWFUL_SECURITY]========================================================
+#ifdef SEC_HASH_INCREMENTAL
+    long long buffer_hash; ///< sum(elem_hash(buffer[i]) * BASE^i), i < size
+    long long buffer_pow;  ///< BASE^size
+#endif
 #ifdef SEC_HASH
     long long hash_right;
 #else
@@ -97,6 +168,12 @@ typedef struct STACK_GENERIC(t) STACK_GENERIC_TYPE;
 long long STACK_GENERIC(hash)(const STACK_GENERIC_TYPE *cake); ///< Calculates hash(cake) the right way
 
 void      STACK_GENERIC(recalculate_hash)   (STACK_GENERIC_TYPE *cake); ///< Calls hash(cake) the right way and sets hash_lr
+long long STACK_GENERIC(elem_hash)   (const STACK_VALUE_TYPE *val); ///< Hash of a single element, normalized into [0, HASH_MODULE)
+long long STACK_GENERIC(buffer_hash) (const STACK_GENERIC_TYPE *cake); ///< Rehashes live prefix of buffer from scratch, O(size)
+#ifdef SEC_HASH_INCREMENTAL
+void      STACK_GENERIC(buffer_hash_push)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE *val); ///< Extends buffer_hash by val placed at buffer[size - 1], O(1)
+void      STACK_GENERIC(buffer_hash_pop) (STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE *val); ///< Retracts val placed at buffer[size] from buffer_hash, O(1)
+#endif
 int       STACK_GENERIC(recalcute_security) (STACK_GENERIC_TYPE *cake); ///< Calls recalculate_security(cake) and sets security vars
 
 int       STACK_GENERIC(construct)      (STACK_GENERIC_TYPE *cake); ///< Constructs stack the right way. Must be called before any operations with stack
@@ -104,6 +181,7 @@ int       STACK_GENERIC(destruct)       (STACK_GENERIC_TYPE *cake); ///< Destruc
 
 int       STACK_GENERIC(dump)     (const STACK_GENERIC_TYPE *cake); ///< Dumps stack in a pretty way
 int       STACK_GENERIC(valid)    (const STACK_GENERIC_TYPE *cake); ///< Checks, if stack is valid, returns 0 if is, err_code otherwise
+int       STACK_GENERIC(valid_fast)(const STACK_GENERIC_TYPE *cake); ///< Same as valid, but with SEC_HASH_INCREMENTAL does not rehash the buffer, O(1)
 
 size_t    STACK_GENERIC(size)     (const STACK_GENERIC_TYPE *cake); ///< Returs current number of elements in stack
 size_t    STACK_GENERIC(capacity) (const STACK_GENERIC_TYPE *cake); ///< Return current max_number of elements in stack
@@ -113,11 +191,18 @@ size_t    STACK_GENERIC(is_full)  (const STACK_GENERIC_TYPE *cake); ///< Returns
 
 int STACK_GENERIC(push) (STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val); ///< Pushes val on the top of stack
 int STACK_GENERIC(pop)  (STACK_GENERIC_TYPE *cake); ///< Pop top val from stack. DOES NOT return value
-int STACK_GENERIC(clear)(STACK_GENERIC_TYPE *cake); ///< Pops all elements from stack
+int STACK_GENERIC(clear)(STACK_GENERIC_TYPE *cake); ///< Drops all elements from stack in O(1), capacity is kept
+
+int STACK_GENERIC(top)   (const STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest); ///< Copies top val into *dest
+int STACK_GENERIC(push_n)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE *vals, const size_t n); ///< Pushes vals[0..n) so that vals[n - 1] is on top. Validates and resizes once
+int STACK_GENERIC(pop_n) (STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest, const size_t n); ///< Pops n vals into dest[0..n) in buffer order, old top goes to dest[n - 1]. dest may be NULL
 
 int STACK_GENERIC(resize)(STACK_GENERIC_TYPE *cake, const size_t new_capacity); ///< Tries to make cake->capacity be new_capacity
-int STACK_GENERIC(resize_up)(STACK_GENERIC_TYPE *cake);
-int STACK_GENERIC(resize_down)(STACK_GENERIC_TYPE *cake);
+int STACK_GENERIC(resize_up)(STACK_GENERIC_TYPE *cake);   ///< Grows capacity by STACK_GROW_COEF
+int STACK_GENERIC(resize_down)(STACK_GENERIC_TYPE *cake); ///< Shrinks capacity if policy says so
+
+int STACK_GENERIC(reserve)      (STACK_GENERIC_TYPE *cake, const size_t capacity); ///< Makes capacity at least capacity, never shrinks
+int STACK_GENERIC(shrink_to_fit)(STACK_GENERIC_TYPE *cake); ///< Makes capacity equal to size (at least 1)
 
 //=============================================================================
 //=============================================================================
@@ -126,9 +211,40 @@ int STACK_GENERIC(resize_down)(STACK_GENERIC_TYPE *cake);
 long long STACK_GENERIC(hash)(const STACK_GENERIC_TYPE *cake) {
     RETURNING_VERIFY(cake != NULL);
     RETURNING_VERIFY(cake->buffer != NULL);
-    return + do_hash((const char*)cake + sizeof(long long), sizeof(STACK_GENERIC_TYPE) - 2 * sizeof(long long))
-           + do_hash(cake->buffer, (cake->capacity - 1) * sizeof(STACK_VALUE_TYPE));
+#ifdef SEC_HASH_INCREMENTAL
+    // buffer is covered by buffer_hash, which lies inside the hashed header
+    return KCTF_HASH((const char*)cake + sizeof(long long), sizeof(STACK_GENERIC_TYPE) - 2 * sizeof(long long));
+#else
+    return + KCTF_HASH((const char*)cake + sizeof(long long), sizeof(STACK_GENERIC_TYPE) - 2 * sizeof(long long))
+           + KCTF_HASH(cake->buffer, (cake->capacity - 1) * sizeof(STACK_VALUE_TYPE));
+#endif
+}
+
+long long STACK_GENERIC(elem_hash)(const STACK_VALUE_TYPE *val) {
+    return (KCTF_HASH(val, sizeof(STACK_VALUE_TYPE)) % HASH_MODULE + HASH_MODULE) % HASH_MODULE;
+}
+
+long long STACK_GENERIC(buffer_hash)(const STACK_GENERIC_TYPE *cake) {
+    long long ret = 0;
+    long long base_pow = 1;
+    for (size_t i = 0; i < cake->size; ++i) {
+        ret = (ret + STACK_GENERIC(elem_hash)(&cake->buffer[i]) * base_pow) % HASH_MODULE;
+        base_pow = base_pow * BASE % HASH_MODULE;
+    }
+    return ret;
+}
+
+#ifdef SEC_HASH_INCREMENTAL
+void STACK_GENERIC(buffer_hash_push)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE *val) {
+    cake->buffer_hash = (cake->buffer_hash + STACK_GENERIC(elem_hash)(val) * cake->buffer_pow) % HASH_MODULE;
+    cake->buffer_pow  = cake->buffer_pow * BASE % HASH_MODULE;
+}
+
+void STACK_GENERIC(buffer_hash_pop)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE *val) {
+    cake->buffer_pow  = cake->buffer_pow * STACK_HASH_INV_BASE % HASH_MODULE;
+    cake->buffer_hash = (cake->buffer_hash - STACK_GENERIC(elem_hash)(val) * cake->buffer_pow % HASH_MODULE + HASH_MODULE) % HASH_MODULE;
 }
+#endif
 
 #ifdef SEC_HASH
 void STACK_GENERIC(recalculate_hash)(STACK_GENERIC_TYPE *cake) {
@@ -139,6 +255,20 @@ void STACK_GENERIC(recalculate_hash)(STACK_GENERIC_TYPE *cake) {
 #endif
 
 int STACK_GENERIC(valid)(const STACK_GENERIC_TYPE *cake) {
+    STACK_PROFILE_SCOPE(valid);
+    RETURNING_VERIFY_OK(STACK_GENERIC(valid_fast)(cake));
+
+#ifdef SEC_HASH_INCREMENTAL
+    if (cake->buffer_hash != STACK_GENERIC(buffer_hash)(cake)) {
+        RETURN_ERROR_VERIFY(ERROR_BAD_HASH);
+    }
+#endif
+
+    return OK;
+}
+
+int STACK_GENERIC(valid_fast)(const STACK_GENERIC_TYPE *cake) {
+    STACK_PROFILE_SCOPE(valid_fast);
     if (!cake) {
         RETURN_ERROR_VERIFY(ERR_STACK_NOT_EXIST);
     }
@@ -184,12 +314,16 @@ int STACK_GENERIC(recalcute_security)(STACK_GENERIC_TYPE *cake) {
 int STACK_GENERIC(construct)(STACK_GENERIC_TYPE *cake) {
     RETURNING_VERIFY(cake != NULL);
 
-    const size_t capacity = 32;
+    const size_t capacity = STACK_REALLOC_MIN_CAPACITY;
     cake->buffer = (STACK_VALUE_TYPE*) calloc(capacity, sizeof(STACK_VALUE_TYPE));
     RETURNING_VERIFY(cake->buffer != NULL);
 
     cake->capacity = capacity;
     cake->size = 0;
+#ifdef SEC_HASH_INCREMENTAL
+    cake->buffer_hash = 0;
+    cake->buffer_pow  = 1;
+#endif
 
     RETURNING_VERIFY_OK(STACK_GENERIC(recalcute_security)(cake));
     STACK_OK(cake);
@@ -208,12 +342,12 @@ int STACK_GENERIC(destruct)(STACK_GENERIC_TYPE *cake) {
 }
 
 size_t STACK_GENERIC(size)(const STACK_GENERIC_TYPE *cake) {
-    RETURNING_VERIFY_OK(STACK_GENERIC(valid)(cake));
+    STACK_OK(cake);
     return cake->size;
 }
 
 size_t STACK_GENERIC(capacity)(const STACK_GENERIC_TYPE *cake) {
-    RETURNING_VERIFY_OK(STACK_GENERIC(valid)(cake));
+    STACK_OK(cake);
     return cake->capacity;
 }
 
@@ -234,8 +368,8 @@ int STACK_GENERIC(dump)(const STACK_GENERIC_TYPE *cake) {
     printf("[   ]<     >: [hash_r](%lld)\n", cake->hash_right);
 #else
 #ifdef SEC_CANARY
-    printf("[   ]<     >: [canary_l](%X)\n", cake->canary_left);
-    printf("[   ]<     >: [canary_r](%X)\n", cake->canary_right);
+    printf("[   ]<     >: [canary_l](%llX)\n", (unsigned long long) cake->canary_left);
+    printf("[   ]<     >: [canary_r](%llX)\n", (unsigned long long) cake->canary_right);
 #endif
 #endif
 
@@ -252,6 +386,7 @@ int STACK_GENERIC(dump)(const STACK_GENERIC_TYPE *cake) {
 }
 
 int STACK_GENERIC(resize)(STACK_GENERIC_TYPE *cake, const size_t new_capacity) {
+    STACK_PROFILE_SCOPE(resize);
     STACK_OK(cake);
 
     if (new_capacity < cake->size) {
@@ -274,7 +409,7 @@ int STACK_GENERIC(resize)(STACK_GENERIC_TYPE *cake, const size_t new_capacity) {
 int STACK_GENERIC(resize_up)(STACK_GENERIC_TYPE *cake) {
     STACK_OK(cake);
 
-    RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, (size_t)((double) STACK_GENERIC(capacity)(cake) * STACK_REALLOC_UP_COEF)));
+    RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, stack_grown_capacity(cake->capacity, cake->capacity + 1)));
 
     STACK_OK(cake);
     return OK;
@@ -283,13 +418,38 @@ int STACK_GENERIC(resize_up)(STACK_GENERIC_TYPE *cake) {
 int STACK_GENERIC(resize_down)(STACK_GENERIC_TYPE *cake) {
     STACK_OK(cake);
 
-    RETURNING_VERIFY(STACK_GENERIC(resize)(cake, (size_t)((double) STACK_GENERIC(capacity)(cake) / STACK_REALLOC_DOWN_COEF * 1.5)) == 0);
+    const size_t new_capacity = stack_shrunk_capacity(cake->capacity, cake->size);
+    if (new_capacity != cake->capacity) {
+        RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, new_capacity));
+    }
+
+    STACK_OK(cake);
+    return OK;
+}
+
+int STACK_GENERIC(reserve)(STACK_GENERIC_TYPE *cake, const size_t capacity) {
+    STACK_OK(cake);
+
+    if (capacity > cake->capacity) {
+        RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, capacity));
+    }
+
+    return OK;
+}
 
+int STACK_GENERIC(shrink_to_fit)(STACK_GENERIC_TYPE *cake) {
     STACK_OK(cake);
+
+    const size_t new_capacity = cake->size > 0 ? cake->size : 1;
+    if (new_capacity != cake->capacity) {
+        RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, new_capacity));
+    }
+
     return OK;
 }
 
 int STACK_GENERIC(push)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val) {
+    STACK_PROFILE_SCOPE(push);
     STACK_OK(cake);
 
     if (STACK_GENERIC(is_full)(cake)) {
@@ -297,6 +457,9 @@ int STACK_GENERIC(push)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val) {
     }
 
     cake->buffer[cake->size++] = val;
+#ifdef SEC_HASH_INCREMENTAL
+    STACK_GENERIC(buffer_hash_push)(cake, &val);
+#endif
     STACK_GENERIC(recalcute_security)(cake);
 
     STACK_OK(cake);
@@ -304,31 +467,97 @@ int STACK_GENERIC(push)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE val) {
 }
 
 int STACK_GENERIC(pop)(STACK_GENERIC_TYPE *cake) {
+    STACK_PROFILE_SCOPE(pop);
     STACK_OK(cake);
     RETURNING_VERIFY(cake->size > 0);
 
     --cake->size;
+#ifdef SEC_HASH_INCREMENTAL
+    STACK_GENERIC(buffer_hash_pop)(cake, &cake->buffer[cake->size]);
+#endif
     STACK_GENERIC(recalcute_security)(cake);
 
-    if ((double) cake->capacity / (double) (cake->size + 1) > STACK_REALLOC_DOWN_COEF) {
+    if (stack_shrunk_capacity(cake->capacity, cake->size) != cake->capacity) {
         STACK_GENERIC(resize_down)(cake);
     }
 
+    STACK_OK(cake);
+    return OK;
+}
+
+int STACK_GENERIC(clear)(STACK_GENERIC_TYPE *cake) {
+    STACK_PROFILE_SCOPE(clear);
+    STACK_OK(cake);
+
+    cake->size = 0;
+#ifdef SEC_HASH_INCREMENTAL
+    cake->buffer_hash = 0;
+    cake->buffer_pow  = 1;
+#endif
     STACK_GENERIC(recalcute_security)(cake);
 
     STACK_OK(cake);
     return OK;
 }
 
-int STACK_GENERIC(clear)(STACK_GENERIC_TYPE *cake) {
+int STACK_GENERIC(top)(const STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest) {
     STACK_OK(cake);
+    RETURNING_VERIFY(dest != NULL);
+    RETURNING_VERIFY(cake->size > 0);
 
-    size_t init_size = STACK_GENERIC(size)(cake);
-    for (size_t i = 0; i < init_size; ++i) {
-        RETURNING_VERIFY_OK(STACK_GENERIC(pop)(cake));
+    *dest = cake->buffer[cake->size - 1];
+    return OK;
+}
+
+int STACK_GENERIC(push_n)(STACK_GENERIC_TYPE *cake, const STACK_VALUE_TYPE *vals, const size_t n) {
+    STACK_PROFILE_SCOPE(push_n);
+    STACK_OK(cake);
+    if (n == 0) {
+        return OK;
     }
+    RETURNING_VERIFY(vals != NULL);
+
+    const size_t new_capacity = stack_grown_capacity(cake->capacity, cake->size + n);
+    if (new_capacity != cake->capacity) {
+        RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, new_capacity));
+    }
+
+    memcpy(cake->buffer + cake->size, vals, n * sizeof(STACK_VALUE_TYPE));
+#ifdef SEC_HASH_INCREMENTAL
+    for (size_t i = 0; i < n; ++i) {
+        STACK_GENERIC(buffer_hash_push)(cake, &vals[i]);
+    }
+#endif
+    cake->size += n;
+    STACK_GENERIC(recalcute_security)(cake);
+
+    return OK;
+}
 
+int STACK_GENERIC(pop_n)(STACK_GENERIC_TYPE *cake, STACK_VALUE_TYPE *dest, const size_t n) {
+    STACK_PROFILE_SCOPE(pop_n);
     STACK_OK(cake);
+    RETURNING_VERIFY(cake->size >= n);
+    if (n == 0) {
+        return OK;
+    }
+
+    cake->size -= n;
+    if (dest) {
+        memcpy(dest, cake->buffer + cake->size, n * sizeof(STACK_VALUE_TYPE));
+    }
+#ifdef SEC_HASH_INCREMENTAL
+    for (size_t i = cake->size + n; i > cake->size; --i) {
+        STACK_GENERIC(buffer_hash_pop)(cake, &cake->buffer[i - 1]);
+    }
+#endif
+    STACK_GENERIC(recalcute_security)(cake);
+
+    const size_t new_capacity = stack_shrunk_capacity(cake->capacity, cake->size);
+    if (new_capacity != cake->capacity) {
+        RETURNING_VERIFY_OK(STACK_GENERIC(resize)(cake, new_capacity));
+    }
+
     return OK;
 }
 
@@ -342,3 +571,11 @@ size_t STACK_GENERIC(is_full)(const STACK_GENERIC_TYPE *cake) {
     return cake->size == cake->capacity;
 }
 //=============================================================================
+
+#ifdef STACK_LOCK_FREE
+#include "lf_stack.h"
+#endif
+
+#ifdef STACK_SEGMENTED
+#include "seg_stack.h"
+#endif
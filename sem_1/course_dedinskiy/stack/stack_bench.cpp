@@ -0,0 +1,97 @@
+#define __USE_MINGW_ANSI_STDIO 1
+
+#include <stdlib.h>
+#include <time.h>
+
+// Build with -DSTACK_SECURITY_LEVEL=N [-DSTACK_HASH_INCREMENTAL] [-DKCTF_RELEASE], see "make bench"
+
+#ifndef STACK_BENCH_N
+#define STACK_BENCH_N 5000
+#endif
+
+#define STACK_VALUE_TYPE int
+#define STACK_VALUE_PRINTF_SPEC "%d"
+#include "stack.h"
+#undef STACK_VALUE_TYPE
+#undef STACK_VALUE_PRINTF_SPEC
+
+#if defined(SEC_HASH_INCREMENTAL)
+const char *BENCH_TIER = "hash_incremental";
+#elif defined(SEC_HASH)
+const char *BENCH_TIER = "hash";
+#elif defined(SEC_CANARY)
+const char *BENCH_TIER = "canary";
+#else
+const char *BENCH_TIER = "none";
+#endif
+
+#ifdef KCTF_RELEASE
+const char *BENCH_MODE = "release";
+#else
+const char *BENCH_MODE = "debug";
+#endif
+
+double ns_per_op(const clock_t begin, const int ops);
+double ns_per_op(const clock_t begin, const int ops) {
+    return (double) (clock() - begin) / CLOCKS_PER_SEC * 1e9 / ops;
+}
+
+/// Alternates push/pop STACK_BENCH_N times starting with size, counts reallocs
+int bench_ping_pong(Stack_int *s, const char *boundary, const int first_push);
+int bench_ping_pong(Stack_int *s, const char *boundary, const int first_push) {
+    int reallocs = 0;
+    size_t capacity = s->capacity;
+
+    const clock_t begin = clock();
+    for (int i = 0; i < STACK_BENCH_N; ++i) {
+        if ((i % 2 == 0) == first_push) {
+            VERIFY_OK(Stack_push_int(s, i));
+        } else {
+            VERIFY_OK(Stack_pop_int(s));
+        }
+        reallocs += s->capacity != capacity;
+        capacity = s->capacity;
+    }
+    const double ping_pong_ns = ns_per_op(begin, STACK_BENCH_N);
+
+    printf("[BNC]<stack>: [mode](%-7s) [level](%2d) [tier](%-16s) [ping_pong](%-6s) [op](%10.1lf ns/op) [reallocs](%d)\n",
+           BENCH_MODE, STACK_SECURITY_LEVEL, BENCH_TIER, boundary, ping_pong_ns, reallocs);
+    return OK;
+}
+
+int main() {
+    Stack_int s = {};
+    VERIFY_OK(Stack_construct_int(&s));
+
+    clock_t begin = clock();
+    for (int i = 0; i < STACK_BENCH_N; ++i) {
+        VERIFY_OK(Stack_push_int(&s, i));
+    }
+    const double push_ns = ns_per_op(begin, STACK_BENCH_N);
+
+    VERIFY_OK(Stack_valid_int(&s));
+
+    begin = clock();
+    for (int i = 0; i < STACK_BENCH_N; ++i) {
+        VERIFY_OK(Stack_pop_int(&s));
+    }
+    const double pop_ns = ns_per_op(begin, STACK_BENCH_N);
+
+    printf("[BNC]<stack>: [mode](%-7s) [level](%2d) [tier](%-16s) [n](%d) [push](%10.1lf ns/op) [pop](%10.1lf ns/op)\n",
+           BENCH_MODE, STACK_SECURITY_LEVEL, BENCH_TIER, STACK_BENCH_N, push_ns, pop_ns);
+
+    // grow boundary: stack is full, next push reallocates
+    while (!Stack_is_full_int(&s)) {
+        VERIFY_OK(Stack_push_int(&s, 0));
+    }
+    bench_ping_pong(&s, "grow", 1);
+
+    // shrink boundary: next pop reallocates
+    while (stack_shrunk_capacity(s.capacity, s.size - 1) == s.capacity) {
+        VERIFY_OK(Stack_pop_int(&s));
+    }
+    bench_ping_pong(&s, "shrink", 0);
+
+    VERIFY_OK(Stack_destruct_int(&s));
+    return 0;
+}
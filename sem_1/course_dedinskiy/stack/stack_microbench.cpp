@@ -0,0 +1,81 @@
+#define __USE_MINGW_ANSI_STDIO 1
+
+#include <stdlib.h>
+
+// ./stack_microbench.out [report.json|report.csv], see "make microbench"
+
+#define STACK_VALUE_TYPE int
+#define STACK_VALUE_PRINTF_SPEC "%d"
+#include "stack.h"
+#undef STACK_VALUE_TYPE
+#undef STACK_VALUE_PRINTF_SPEC
+
+const size_t MICROBENCH_BATCH = 64;
+
+KCTF_BENCH(push_pop) {
+    Stack_int s = {};
+    Stack_construct_int(&s);
+
+    KCTF_BENCH_LOOP {
+        Stack_push_int(&s, 1);
+        Stack_pop_int(&s);
+    }
+
+    Stack_destruct_int(&s);
+}
+
+KCTF_BENCH(push_n_pop_n) {
+    Stack_int s = {};
+    Stack_construct_int(&s);
+    int vals[MICROBENCH_BATCH] = {};
+
+    KCTF_BENCH_LOOP {
+        Stack_push_n_int(&s, vals, MICROBENCH_BATCH);
+        Stack_pop_n_int(&s, vals, MICROBENCH_BATCH);
+    }
+
+    Stack_destruct_int(&s);
+}
+
+KCTF_BENCH(top) {
+    Stack_int s = {};
+    Stack_construct_int(&s);
+    Stack_push_int(&s, 1);
+
+    int val = 0;
+    KCTF_BENCH_LOOP {
+        Stack_top_int(&s, &val);
+        KCTF_DO_NOT_OPTIMIZE(val);
+    }
+
+    Stack_destruct_int(&s);
+}
+
+KCTF_BENCH(valid) {
+    Stack_int s = {};
+    Stack_construct_int(&s);
+    for (size_t i = 0; i < MICROBENCH_BATCH; ++i) {
+        Stack_push_int(&s, (int) i);
+    }
+
+    KCTF_BENCH_LOOP {
+        KCTF_DO_NOT_OPTIMIZE(Stack_valid_int(&s));
+    }
+
+    Stack_destruct_int(&s);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && kctf_bench_report_to(argv[1])) {
+        printf("[ERR]<microbench>: can't open [%s]\n", argv[1]);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    KCTF_BENCH_RUN(push_pop);
+    KCTF_BENCH_RUN(push_n_pop_n);
+    KCTF_BENCH_RUN(top);
+    KCTF_BENCH_RUN(valid);
+
+    kctf_bench_report_close();
+    return 0;
+}